@@ -0,0 +1,509 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Created: 17 Oct 2026 7:41:02pm
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include "../../Source/PluginProcessor.h"
+
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter();
+
+//While this is set, every heap allocation is counted, on any thread, so the renders can check that processBlock makes none.
+//Only this check's own build replaces the allocator, never the plugin's. Every form is replaced, so what one allocates
+//another can always free
+static std::atomic<bool> countingAllocations { false };
+static std::atomic<int> allocationsCounted { 0 };
+
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept
+{
+    if (countingAllocations.load (std::memory_order_relaxed))
+        allocationsCounted++;
+
+    return std::malloc (size > 0 ? size : 1);
+}
+
+void* operator new (std::size_t size)
+{
+    if (void* memory = operator new (size, std::nothrow))
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)                                     { return operator new (size); }
+void* operator new[] (std::size_t size, const std::nothrow_t&) noexcept     { return operator new (size, std::nothrow); }
+
+void operator delete (void* memory) noexcept                                { std::free (memory); }
+void operator delete (void* memory, std::size_t) noexcept                   { std::free (memory); }
+void operator delete (void* memory, const std::nothrow_t&) noexcept         { std::free (memory); }
+void operator delete[] (void* memory) noexcept                              { std::free (memory); }
+void operator delete[] (void* memory, std::size_t) noexcept                 { std::free (memory); }
+void operator delete[] (void* memory, const std::nothrow_t&) noexcept       { std::free (memory); }
+
+/*
+ An offline check of what the DSP promises but no listening test can tell. Every case is compared bit for bit. Run it
+ after a change to the DSP: it prints each case and returns 1 if any failed.
+ */
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int renderLength = 96000;
+
+    using Settings = std::vector<std::pair<juce::String, float>>;
+
+    //Chords that overlap and release, then more notes in the voices they freed, at different velocities. Velocity 0 is a
+    //note off
+    struct NoteEvent { int time; int note; float velocity; };
+
+    const NoteEvent notes[] = {
+        { 0, 60, 0.9f }, { 3, 64, 0.6f }, { 517, 67, 0.75f }, { 12000, 72, 1.0f }, { 30000, 60, 0.0f },
+        { 30001, 64, 0.0f }, { 40000, 48, 0.5f }, { 40037, 55, 0.8f }, { 61000, 72, 0.0f }, { 70000, 67, 0.0f },
+        { 70000, 48, 0.0f }, { 80000, 55, 0.0f }
+    };
+
+    //Where render() makes its changes: the start of a block at every block size checked (74 blocks of 512, 1024 of 37)
+    constexpr int changeTime = 37888;
+
+    void setParameters (MidiTryAudioProcessor& processor, const Settings& settings)
+    {
+        for (auto& setting : settings)
+        {
+            auto* parameter = processor.parameters.getParameter (setting.first);
+            jassert (parameter != nullptr);
+            parameter->setValueNotifyingHost (parameter->convertTo0to1 (setting.second));
+        }
+    }
+
+    /// Both channels of the whole render, one after the other. The changes are made at changeTime
+    std::vector<float> render (const Settings& settings, int blockSize, const Settings& changes = {})
+    {
+        std::unique_ptr<juce::AudioProcessor> plugin (createPluginFilter());
+        auto& processor = static_cast<MidiTryAudioProcessor&> (*plugin);
+
+        //Before prepareToPlay, as the render threads are started there. The noise is on by default, and only comes out
+        //the same twice when it's deterministic
+        setParameters (processor, { { "noiseDeterministic", 1.0f } });
+        setParameters (processor, settings);
+
+        plugin->prepareToPlay (sampleRate, blockSize);
+
+        juce::AudioBuffer<float> buffer (2, blockSize);
+        juce::MidiBuffer midi;
+        std::vector<float> left, right;
+
+        for (int start = 0; start < renderLength; start += blockSize)
+        {
+            const int numSamples = juce::jmin (blockSize, renderLength - start);
+            buffer.setSize (2, numSamples, false, false, true);
+            midi.clear();
+
+            if (start == changeTime)
+                setParameters (processor, changes);
+
+            for (auto& event : notes)
+                if (event.time >= start && event.time < start + numSamples)
+                    midi.addEvent (event.velocity > 0.0f ? juce::MidiMessage::noteOn (1, event.note, event.velocity)
+                                                         : juce::MidiMessage::noteOff (1, event.note),
+                                   event.time - start);
+
+            countingAllocations = true;
+            plugin->processBlock (buffer, midi);
+            countingAllocations = false;
+
+            left.insert (left.end(), buffer.getReadPointer (0), buffer.getReadPointer (0) + numSamples);
+            right.insert (right.end(), buffer.getReadPointer (1), buffer.getReadPointer (1) + numSamples);
+        }
+
+        plugin->releaseResources();
+
+        left.insert (left.end(), right.begin(), right.end());
+        return left;
+    }
+
+    bool isSame (const std::vector<float>& a, const std::vector<float>& b)
+    {
+        return a.size() == b.size() && std::memcmp (a.data(), b.data(), a.size() * sizeof (float)) == 0;
+    }
+
+    bool isSilent (const std::vector<float>& samples)
+    {
+        return std::all_of (samples.begin(), samples.end(), [] (float sample) { return sample == 0.0f; });
+    }
+
+    /// The vector kernels against BitQuantizer::quantizeScalar(), at every whole bit depth and every tail length, with and
+    /// without noise
+    bool quantizerMatchesScalar()
+    {
+        juce::Random random (1);
+        BitQuantizer quantizer;
+        std::vector<float> input (67), noise (67), vectorOut, scalarOut;
+        const SmoothedSpan noiseGain { nullptr, 0.3f };
+
+        for (auto& sample : input)
+            sample = (random.nextFloat() * 2.0f - 1.0f) * 1.5f;
+
+        for (auto& sample : noise)
+            sample = random.nextFloat() * 2.0f - 1.0f;
+
+        for (int bits = 1; bits <= 24; bits++)
+        {
+            quantizer.setBitDepth ((float) bits);
+            const float step = 1.0f / powf (2.0f, (float) bits);
+
+            for (int numSamples = 1; numSamples <= (int) input.size(); numSamples++)
+            {
+                for (const float* noiseIn : { (const float*) nullptr, (const float*) noise.data() })
+                {
+                    vectorOut.assign (input.begin(), input.begin() + numSamples);
+                    scalarOut = vectorOut;
+
+                    quantizer.process (vectorOut.data(), noiseIn, noiseGain, numSamples);
+                    BitQuantizer::quantizeScalar (scalarOut.data(), noiseIn, noiseGain.value, numSamples, step);
+
+                    if (! isSame (vectorOut, scalarOut))
+                        return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /// Millions of white noise samples a second, as the noise engine times itself
+    double noiseThroughput()
+    {
+        NoiseGenerators noise;
+        std::vector<float> block (512);
+
+        for (int i = 0; i < 4000; i++)
+            noise.fillWhiteNoise (block.data(), (int) block.size());
+
+        return noise.getSamplesPerSecond() / 1.0e6;
+    }
+
+    /// The worst error of a sine kernel against sin in double, from lowest to highest cycles: on a fine grid, and at every
+    /// float either side of each quarter cycle, where the kernels fold and wrap
+    double sineError (float (*kernel) (float), float lowest, float highest)
+    {
+        double worst = 0.0;
+
+        auto measure = [&] (float p)
+        {
+            const double error = std::abs ((double) kernel (p) - std::sin (juce::MathConstants<double>::twoPi * (double) p));
+            worst = juce::jmax (worst, error);
+        };
+
+        constexpr int gridSize = 1 << 20;
+
+        for (int i = 0; i <= gridSize; i++)
+            measure (lowest + (highest - lowest) * (float) i / (float) gridSize);
+
+        for (float edge = lowest; edge <= highest; edge += 0.25f)
+        {
+            float below = edge, above = edge;
+
+            for (int i = 0; i < 4096; i++)
+            {
+                measure (below = std::nextafter (below, lowest - 1.0f));
+                measure (above = std::nextafter (above, highest + 1.0f));
+            }
+        }
+
+        return worst;
+    }
+
+    /// The loudest harmonic any level of the built in wavetables holds above the ones it keeps, as an amplitude
+    double wavetableLeakage()
+    {
+        WavetableBank bank;
+        constexpr int size = Wavetable::tableSize;
+        std::vector<double> cosines (size), sines (size);
+
+        for (int i = 0; i < size; i++)
+        {
+            cosines[(size_t) i] = std::cos (juce::MathConstants<double>::twoPi * i / size);
+            sines[(size_t) i] = std::sin (juce::MathConstants<double>::twoPi * i / size);
+        }
+
+        double worst = 0.0;
+
+        for (auto shape : { WavetableBank::triangle, WavetableBank::saw })
+        {
+            for (int level = 0; level < Wavetable::numLevels; level++)
+            {
+                const float* table = bank.getTable (shape).getLevel (level);
+
+                for (int harmonic = Wavetable::getNumHarmonics (level) + 1; harmonic <= size / 2; harmonic++)
+                {
+                    double sumCos = 0.0, sumSin = 0.0;
+
+                    for (int i = 0; i < size; i++)
+                    {
+                        const size_t index = (size_t) ((harmonic * i) & (size - 1));
+                        sumCos += table[i] * cosines[index];
+                        sumSin += table[i] * sines[index];
+                    }
+
+                    worst = juce::jmax (worst, 2.0 * std::sqrt (sumCos * sumCos + sumSin * sumSin) / size);
+                }
+            }
+        }
+
+        return worst;
+    }
+
+    /// Whether the level Wavetable::getLevelFor() picks keeps every harmonic below Nyquist, for every phase increment up
+    /// to a whole cycle a sample: on a sweep, and on each level's limit and just past it
+    bool wavetableLevelsBelowNyquist()
+    {
+        auto belowNyquist = [] (float delta)
+        {
+            return Wavetable::getNumHarmonics (Wavetable::getLevelFor (delta)) * (double) delta <= 0.5;
+        };
+
+        for (float delta = 1.0e-5f; delta <= 1.0f; delta *= 1.001f)
+            if (! belowNyquist (delta))
+                return false;
+
+        for (int level = 0; level < Wavetable::numLevels; level++)
+        {
+            const float limit = (float) (1 << level) / (float) Wavetable::tableSize;
+
+            if (! belowNyquist (limit) || ! belowNyquist (std::nextafter (limit, 2.0f)))
+                return false;
+        }
+
+        return true;
+    }
+
+    /// How long the synth takes a sample of a held chord with this many render threads: 32 notes of 4 unison copies, 128
+    /// voices in all
+    double nanosecondsPerSample (int threads, int blockSize)
+    {
+        std::unique_ptr<juce::AudioProcessor> plugin (createPluginFilter());
+        auto& processor = static_cast<MidiTryAudioProcessor&> (*plugin);
+
+        setParameters (processor, { { "polyphony", 512.0f }, { "unison", 4.0f }, { "detuneOn", 1.0f },
+                                    { "renderThreads", (float) threads } });
+        plugin->prepareToPlay (sampleRate, blockSize);
+
+        juce::AudioBuffer<float> buffer (2, blockSize);
+        juce::MidiBuffer midi;
+
+        //The notes start in a block of their own, so every timed block has the whole chord
+        for (int i = 0; i < 32; i++)
+            midi.addEvent (juce::MidiMessage::noteOn (1, 36 + i * 2, 0.8f), 0);
+
+        plugin->processBlock (buffer, midi);
+        midi.clear();
+
+        const int numBlocks = renderLength / blockSize;
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+
+        for (int block = 0; block < numBlocks; block++)
+            plugin->processBlock (buffer, midi);
+
+        const double seconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+        plugin->releaseResources();
+
+        return seconds * 1.0e9 / (double) (numBlocks * blockSize);
+    }
+
+    /// What each voice of the pool takes, in bytes, when prepared for blocks of blockSize
+    int memoryPerVoice (int blockSize)
+    {
+        std::unique_ptr<juce::AudioProcessor> plugin (createPluginFilter());
+        plugin->prepareToPlay (sampleRate, blockSize);
+
+        return (int) static_cast<MidiTryAudioProcessor&> (*plugin).getMemoryPerVoice();
+    }
+
+    /// DelayLine::process() on blocks against one sample at a time, with feedback, at delays shorter and longer than a block,
+    /// for every interpolation
+    bool delayBlocksMatchSamples()
+    {
+        juce::Random random (2);
+        std::vector<float> input (4096), blockOut (input.size()), sampleOut (input.size());
+        constexpr int blockSize = 64;
+
+        for (auto& sample : input)
+            sample = random.nextFloat() * 2.0f - 1.0f;
+
+        for (int type = 0; type < DelayInterpolation::numTypes; type++)
+        {
+            for (float delay : { 2.5f, 37.0f, 64.0f, 100.25f, 700.6f })
+            {
+                DelayLine byBlock, bySample;
+                DspArena arena;
+
+                //Laid out, then prepared again onto the slab, as prepareToPlay does
+                arena.beginLayout();
+
+                for (auto* line : { &byBlock, &bySample })
+                    line->setSizeInSamples (1024, arena);
+
+                arena.allocateSlab();
+
+                for (auto* line : { &byBlock, &bySample })
+                {
+                    line->setSizeInSamples (1024, arena);
+                    line->setInterpolation ((DelayInterpolation::Type) type);
+                    line->setDelayTimeInSamples (delay);
+                    line->setFeedback (0.7f);
+                }
+
+                for (int start = 0; start < (int) input.size(); start += blockSize)
+                    byBlock.process (input.data() + start, blockOut.data() + start, blockSize);
+
+                for (size_t i = 0; i < input.size(); i++)
+                    sampleOut[i] = bySample.process (input[i]);
+
+                if (! isSame (blockOut, sampleOut))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    //"RenderCheck scaling" times the render threads instead, from none to all 7, at a few block sizes. It only scales as
+    //far as the machine has cores
+    if (argc > 1 && juce::String (argv[1]) == "scaling")
+    {
+        for (int blockSize : { 64, 256, 1024 })
+        {
+            const double alone = nanosecondsPerSample (0, blockSize);
+
+            for (int threads = 0; threads <= 7; threads++)
+            {
+                const double time = threads == 0 ? alone : nanosecondsPerSample (threads, blockSize);
+                std::cout << blockSize << " sample blocks, " << threads << " render threads: "
+                          << juce::String (time, 1) << " ns a sample, " << juce::String (alone / time, 2)
+                          << "x the speed of none" << std::endl;
+            }
+        }
+
+        return 0;
+    }
+
+    int failures = 0;
+
+    auto check = [&failures] (bool passed, const juce::String& name)
+    {
+        std::cout << (passed ? "pass  " : "FAIL  ") << name << std::endl;
+
+        if (! passed)
+            failures++;
+    };
+
+    //Numbers to compare between machines and builds, not checked
+    auto report = [] (const juce::String& line)
+    {
+        std::cout << "      " << line << std::endl;
+    };
+
+    check (quantizerMatchesScalar(), "vector quantizer matches the scalar path");
+    report ("noise: " + juce::String (noiseThroughput(), 1) + " million white noise samples a second");
+
+    for (int blockSize : { 64, 512 })
+        report ("voices: " + juce::String (memoryPerVoice (blockSize)) + " bytes each at " + juce::String (blockSize)
+                + " sample blocks");
+
+    //Each sine kernel as accurate as SineKernels.h says, with a dB to spare. The standard one only over a cycle, as its
+    //truncated pi drifts further out
+    struct SineCase { juce::String name; float (*kernel) (float); float lowest, highest; double limitDb; };
+
+    const SineCase sineCases[] = {
+        { "standard",   [] (float p) { return SineKernels::standard (p); },    0.0f, 1.0f, -104.0 },
+        { "polynomial", [] (float p) { return SineKernels::polynomial (p); }, -3.0f, 5.0f, -132.0 },
+        { "table",      [] (float p) { return SineKernels::table (p); },      -3.0f, 5.0f, -117.0 }
+    };
+
+    for (auto& sineCase : sineCases)
+    {
+        const double errorDb = 20.0 * std::log10 (sineError (sineCase.kernel, sineCase.lowest, sineCase.highest));
+        check (errorDb < sineCase.limitDb, "sine: " + sineCase.name + " kernel at " + juce::String (errorDb, 1)
+                                               + " dB against sin, limit " + juce::String ((int) sineCase.limitDb));
+    }
+
+    const double leakageDb = 20.0 * std::log10 (wavetableLeakage());
+    check (leakageDb < -100.0, "wavetables: loudest harmonic a level shouldn't hold at " + juce::String (leakageDb, 1)
+                                   + " dB, limit -100");
+    check (wavetableLevelsBelowNyquist(), "wavetables: the level for every frequency stays below Nyquist");
+
+    //The same render at other block sizes, odd ones included, for each part of the DSP. The changes are parameters
+    //moving part way through
+    struct BlockSizeCase { juce::String name; Settings settings, changes; };
+
+    const BlockSizeCase blockSizeCases[] = {
+        { "defaults",   {} },
+        { "crushed",    { { "bits", 5.0f }, { "rate", 3.3f }, { "noise", 60.0f }, { "noiseStereo", 1.0f } } },
+        { "velvet",     { { "noise", 70.0f }, { "noiseColour", 3.0f } } },
+        { "pulse",      { { "oscShape", 1.0f }, { "pulseWidth", 0.3f }, { "detuneOn", 1.0f }, { "pmRouting", 2.0f } },
+                        { { "pulseWidth", 0.8f } } },
+        { "envelopes",  { { "attack", 0.013f }, { "decay", 0.05f }, { "sustain", 0.5f }, { "release", 0.021f },
+                          { "envShape", 1.0f } } },
+        { "detuned",    { { "detuneOn", 1.0f } } },
+        { "unison",     { { "detuneOn", 1.0f }, { "unison", 4.0f }, { "unisonWidth", 0.7f } } },
+        { "voices",     { { "detuneOn", 1.0f }, { "unison", 4.0f }, { "unisonWidth", 0.7f }, { "pmRouting", 1.0f },
+                          { "velocity", 0.5f } } },
+        { "automated",  { { "detuneOn", 1.0f }, { "noise", 30.0f }, { "bits", 12.0f } },
+                        { { "noise", 80.0f }, { "bits", 6.0f }, { "detuneMix", 0.2f }, { "lfoSpeed", 60.0f } } },
+        { "delays",     { { "modMix", 0.5f }, { "modMode", 1.0f }, { "echoMix", 0.5f }, { "echoInterpolation", 3.0f } } },
+    };
+
+    for (auto& testCase : blockSizeCases)
+    {
+        const auto reference = render (testCase.settings, 512, testCase.changes);
+        check (! isSilent (reference), testCase.name + ": renders sound");
+
+        for (int blockSize : { 64, 37, 1 })
+            check (isSame (render (testCase.settings, blockSize, testCase.changes), reference),
+                   testCase.name + ": same at " + juce::String (blockSize) + " sample blocks as at 512");
+    }
+
+    //The voices shared out between render threads, summed in the same order whatever thread ran them
+    const Settings chord = {
+        { "unison", 8.0f }, { "polyphony", 64.0f },
+        { "detuneOn", 1.0f }
+    };
+    const auto singleThreaded = render (chord, 256);
+
+    for (float threads : { 1.0f, 3.0f, 7.0f })
+    {
+        auto settings = chord;
+        settings.push_back ({ "renderThreads", threads });
+        check (isSame (render (settings, 256), singleThreaded),
+               "same with " + juce::String ((int) threads) + " render threads as with none");
+    }
+
+    //Deterministic noise is keyed by the seed and the timeline, not by the instance
+    const Settings seeded = { { "noise", 80.0f }, { "noiseSeed", 7.0f } };
+    check (isSame (render (seeded, 512), render (seeded, 512)), "deterministic noise: same from two instances");
+
+    auto otherSeed = seeded;
+    otherSeed.back().second = 8.0f;
+    check (! isSame (render (otherSeed, 512), render (seeded, 512)), "deterministic noise: another seed changes it");
+
+    check (delayBlocksMatchSamples(), "delay line: blocks match one sample at a time, with feedback");
+
+    //Everything processBlock uses comes from prepareToPlay (see "DspArena.h")
+    check (allocationsCounted == 0, "no heap allocations in processBlock, in any render above");
+
+    std::cout << (failures == 0 ? "All passed" : juce::String (failures) + " failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
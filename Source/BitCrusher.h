@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    BitCrusher.h
+    Created: 17 Oct 2026 12:20:37pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "BitQuantizer.h"
+#include "SampleHold.h"
+
+/**
+ The whole crush stage of "processBlock" as one pass: noise modulation, bit depth reduction and sample-and-hold.
+
+ The old code walked the audio about eight times per block (copy out, clear the noise buffer, scale the noise, add it twice,
+ multiply it by the signal, add it back, quantize, copy back). Here every channel is crushed in place in the host buffer, in
+ tiles that stay in L1. For each tile the noise and quantize kernel reads and writes every sample once, then the hold runs
+ over the same tile while it is still in cache. The hold only runs when the rate reduction is on, and the noise only when its
+ gain is above zero. The noise can be shared by all channels or given per channel.
+
+ The bit depth and the noise gain can be ramps for the block while they are being smoothed (see "ParamSmoother.h").
+
+ Output is bit-identical to the old noiseBuffer/currentOutputBuffer path.
+ */
+class BitCrusher
+{
+public:
+    /// Takes the hold's state from the arena: call from prepareToPlay
+    void prepare(int numChannels, DspArena& arena)
+    {
+        hold.prepare(numChannels, arena);
+    }
+
+    void reset()
+    {
+        hold.reset();
+    }
+
+    /// Set once per block. A ramp runs from the start of the block, and must last until process() is done with it
+    void setBitDepth(const SmoothedSpan& bitDepth)
+    {
+        quantizer.setBitDepth(bitDepth.value);
+        bitDepths = bitDepth.ramp;
+    }
+
+    /// Set once per block. See SampleHold::setRatio()
+    void setRateReduction(float ratio)      { hold.setRatio(ratio); }
+
+    /**
+     Crush the channels in place.
+
+     @param channels the host buffer's write pointers, holding the synth output
+     @param startSample first sample of the channels to crush
+     @param noise noise for the samples from startSample on, one span per noise channel. Can be null.
+     @param numNoiseChannels 1 shares the same noise across all channels
+     @param noiseGain noise level as gain, from the start of the block like the bit depth. A steady 0 skips the noise.
+     */
+    void process(float* const* channels, int numChannels, int startSample, int numSamples,
+                 const float* const* noise, int numNoiseChannels, const SmoothedSpan& noiseGain)
+    {
+        if ((! noiseGain.isRamping() && noiseGain.value <= 0.0f) || numNoiseChannels < 1)
+            noise = nullptr;
+
+        const SmoothedSpan gain = noiseGain.from(startSample);
+        const float* depths = bitDepths != nullptr ? bitDepths + startSample : nullptr;
+
+        const bool holding = hold.isActive();
+
+        if (! holding)
+        {
+            //Nothing to carry between the stages, so one straight pass per channel
+            for (int chan = 0; chan < numChannels; chan++)
+                quantizer.process(channels[chan] + startSample, noiseFor(noise, numNoiseChannels, chan), gain, numSamples, depths);
+
+            //So the hold starts cleanly when the reduction comes back on
+            hold.reset();
+            return;
+        }
+
+        const SampleHold::Countdown startCountdown = hold.beginBlock();
+        SampleHold::Countdown endCountdown = startCountdown;
+
+        for (int chan = 0; chan < numChannels; chan++)
+        {
+            float* data = channels[chan] + startSample;
+            const float* chanNoise = noiseFor(noise, numNoiseChannels, chan);
+            SampleHold::Countdown countdown = startCountdown;
+
+            for (int start = 0; start < numSamples; start += tileSize)
+            {
+                const int num = juce::jmin(tileSize, numSamples - start);
+
+                quantizer.process(data + start, chanNoise != nullptr ? chanNoise + start : nullptr, gain.from(start), num,
+                                  depths != nullptr ? depths + start : nullptr);
+                countdown = hold.processSpan(chan, data + start, num, countdown);
+            }
+
+            endCountdown = countdown;
+        }
+
+        hold.endBlock(endCountdown);
+    }
+
+    const BitQuantizer& getQuantizer() const     { return quantizer; }
+
+private:
+    static const float* noiseFor(const float* const* noise, int numNoiseChannels, int chan)
+    {
+        return noise != nullptr ? noise[juce::jmin(chan, numNoiseChannels - 1)] : nullptr;
+    }
+
+    //256 floats is 1KB, so a tile stays in L1 between the quantize and hold passes
+    static constexpr int tileSize = 256;
+
+    BitQuantizer quantizer;
+    SampleHold hold;
+
+    //The bit depth ramp of the current block, or null while the depth is steady
+    const float* bitDepths = nullptr;
+};
@@ -0,0 +1,321 @@
+/*
+  ==============================================================================
+
+    BitQuantizer.h
+    Created: 17 Oct 2026 10:12:04am
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include "ParamSmoother.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#elif JUCE_ARM && JUCE_64BIT
+ #include <arm_neon.h>
+#endif
+
+#if JUCE_INTEL && ! JUCE_MSVC
+ #define ALPACON_TARGET(isa) __attribute__ ((target (isa)))
+#else
+ #define ALPACON_TARGET(isa)
+#endif
+
+/**
+ Bit depth reduction engine used by the crusher in "processBlock".
+
+ The old loop did "val - fmodf (val, 1 / powf (2, bitDepth))" for every sample. Here the step size is worked out once per block
+ with setBitDepth(), and whole channel spans are quantized with the widest kernel the CPU has (AVX, SSE4.1, SSE2 or NEON).
+ The kernel is picked once at construction.
+
+ The "bits" parameter moves in whole bits, so the step is a power of two. Then "val - fmodf (val, step)" is exactly
+ "trunc (val * levels) * step": both products are exact, and fmodf is exact by definition. The vector kernels use that
+ form and add +0.0f so that a "-0.0f" result comes out as "+0.0f", like the subtraction did. Output is bit-identical to the
+ scalar path for every finite input. A fractional bit depth falls back to the original scalar formula.
+
+ The noise gain and the bit depth can each be a ramp while they are being smoothed (see "ParamSmoother.h"). A noise gain ramp
+ is read by the vector kernels like the noise itself. A bit depth ramp passes through fractional depths, so its samples go
+ through the scalar formula with their own step, only for as long as the ramp lasts.
+ */
+class BitQuantizer
+{
+public:
+    BitQuantizer()
+    {
+        //Choose the kernel once, so there is no dispatch cost per block
+       #if JUCE_INTEL
+        if (juce::SystemStats::hasAVX())
+        {
+            vectorKernels[0] = quantizeAVX<false, false>;
+            vectorKernels[1] = quantizeAVX<true, false>;
+            vectorKernels[2] = quantizeAVX<true, true>;
+            kernelName = "AVX";
+        }
+        else if (juce::SystemStats::hasSSE41())
+        {
+            vectorKernels[0] = quantizeSSE41<false, false>;
+            vectorKernels[1] = quantizeSSE41<true, false>;
+            vectorKernels[2] = quantizeSSE41<true, true>;
+            kernelName = "SSE4.1";
+        }
+        else
+        {
+            vectorKernels[0] = quantizeSSE2<false, false>;
+            vectorKernels[1] = quantizeSSE2<true, false>;
+            vectorKernels[2] = quantizeSSE2<true, true>;
+            kernelName = "SSE2";
+        }
+       #elif JUCE_ARM && JUCE_64BIT
+        vectorKernels[0] = quantizeNEON<false, false>;
+        vectorKernels[1] = quantizeNEON<true, false>;
+        vectorKernels[2] = quantizeNEON<true, true>;
+        kernelName = "NEON";
+       #endif
+    }
+
+    /// Call once per block. Works out the quantization step for the given bit depth.
+    void setBitDepth(float bitDepth)
+    {
+        levels = powf(2, bitDepth);
+        step = 1 / levels;
+        isPowerOfTwo = (bitDepth == std::floor(bitDepth));
+    }
+
+    /// Quantize a span of samples in place
+    void process(float* data, int numSamples) const
+    {
+        process(data, nullptr, SmoothedSpan(), numSamples);
+    }
+
+    /**
+     Modulate a span by noise and quantize it, in one pass: data[i] = quantize (data[i] + (noise[i] * noiseGain) * data[i]).
+     Pass a null noise pointer to skip the noise.
+
+     @param noiseGain the gain for the samples of this span, steady or a ramp
+     @param bitDepths one bit depth per sample while the depth is being smoothed, otherwise null for the one set with
+                      setBitDepth()
+     */
+    void process(float* data, const float* noise, const SmoothedSpan& noiseGain, int numSamples,
+                 const float* bitDepths = nullptr) const
+    {
+        if (bitDepths != nullptr)
+        {
+            if (noise == nullptr)
+                quantizeRamp<false, false>(data, noise, noiseGain, numSamples, bitDepths);
+            else if (noiseGain.isRamping())
+                quantizeRamp<true, true>(data, noise, noiseGain, numSamples, bitDepths);
+            else
+                quantizeRamp<true, false>(data, noise, noiseGain, numSamples, bitDepths);
+
+            return;
+        }
+
+        const int kernel = noise == nullptr ? 0 : noiseGain.isRamping() ? 2 : 1;
+
+        if (isPowerOfTwo && vectorKernels[kernel] != nullptr)
+            vectorKernels[kernel](data, noise, noiseGain.ramp, noiseGain.value, numSamples, levels, step);
+        else if (kernel == 2)
+            quantizeRamp<true, true>(data, noise, noiseGain, numSamples, nullptr);
+        else
+            quantizeScalar(data, noise, noiseGain.value, numSamples, step);
+    }
+
+    /// The name of the kernel picked for this CPU, handy for logging
+    const char* getKernelName() const         { return kernelName; }
+
+    /// The reference implementation. This is what "processBlock" used to do for every sample
+    static void quantizeScalar(float* data, const float* noise, float noiseGain, int numSamples, float step)
+    {
+        for (int i = 0; i < numSamples; i++)
+        {
+            float val = data[i];
+
+            if (noise != nullptr)
+                val = addNoise(val, noise[i], noiseGain);
+
+            float remainder = fmodf(val, step);
+            data[i] = val - remainder;
+        }
+    }
+
+    /// The same result as quantizeScalar() when step is a power of two. Used for the tails of the vector kernels.
+    static inline float quantizeSample(float val, float levels, float step)
+    {
+        return std::trunc(val * levels) * step + 0.0f;
+    }
+
+    /// The noise is both multiplied with and added to the signal. Same operation order as the old noiseBuffer steps.
+    static inline float addNoise(float val, float noise, float noiseGain)
+    {
+        //Separate statements, so the compiler does not contract this into a fused multiply-add
+        float modulation = noise * noiseGain;
+        modulation = modulation * val;
+        return val + modulation;
+    }
+
+private:
+    using Kernel = void (*) (float*, const float*, const float*, float, int, float, float);
+
+    template <bool withNoise, bool gainRamp>
+    static inline float tailSample(float val, const float* noise, const float* gains, float noiseGain, int i, float levels,
+                                   float step)
+    {
+        if (withNoise)
+            val = addNoise(val, noise[i], gainRamp ? gains[i] : noiseGain);
+
+        return quantizeSample(val, levels, step);
+    }
+
+    /**
+     The scalar formula with the noise gain and the step taken per sample where they are ramps. With a steady gain and no
+     bit depths it is quantizeScalar(). A depth of exactly bitDepth gives the same samples as setBitDepth (bitDepth).
+     */
+    template <bool withNoise, bool gainRamp>
+    void quantizeRamp(float* data, const float* noise, const SmoothedSpan& noiseGain, int numSamples,
+                      const float* bitDepths) const
+    {
+        for (int i = 0; i < numSamples; i++)
+        {
+            float val = data[i];
+
+            if (withNoise)
+                val = addNoise(val, noise[i], gainRamp ? noiseGain.ramp[i] : noiseGain.value);
+
+            const float sampleStep = bitDepths != nullptr ? 1 / powf(2, bitDepths[i]) : step;
+            data[i] = val - fmodf(val, sampleStep);
+        }
+    }
+
+   #if JUCE_INTEL
+    template <bool withNoise, bool gainRamp>
+    ALPACON_TARGET("avx")
+    static void quantizeAVX(float* data, const float* noise, const float* gains, float noiseGain, int numSamples,
+                            float levels, float step)
+    {
+        const __m256 l = _mm256_set1_ps(levels);
+        const __m256 s = _mm256_set1_ps(step);
+        const __m256 g = _mm256_set1_ps(noiseGain);
+        const __m256 zero = _mm256_setzero_ps();
+
+        int i = 0;
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            __m256 v = _mm256_loadu_ps(data + i);
+
+            if (withNoise)
+            {
+                const __m256 gain = gainRamp ? _mm256_loadu_ps(gains + i) : g;
+                v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(noise + i), gain), v));
+            }
+
+            v = _mm256_round_ps(_mm256_mul_ps(v, l), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            _mm256_storeu_ps(data + i, _mm256_add_ps(_mm256_mul_ps(v, s), zero));
+        }
+
+        for (; i < numSamples; i++)
+            data[i] = tailSample<withNoise, gainRamp>(data[i], noise, gains, noiseGain, i, levels, step);
+    }
+
+    template <bool withNoise, bool gainRamp>
+    ALPACON_TARGET("sse4.1")
+    static void quantizeSSE41(float* data, const float* noise, const float* gains, float noiseGain, int numSamples,
+                              float levels, float step)
+    {
+        const __m128 l = _mm_set1_ps(levels);
+        const __m128 s = _mm_set1_ps(step);
+        const __m128 g = _mm_set1_ps(noiseGain);
+        const __m128 zero = _mm_setzero_ps();
+
+        int i = 0;
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            __m128 v = _mm_loadu_ps(data + i);
+
+            if (withNoise)
+            {
+                const __m128 gain = gainRamp ? _mm_loadu_ps(gains + i) : g;
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(noise + i), gain), v));
+            }
+
+            v = _mm_round_ps(_mm_mul_ps(v, l), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            _mm_storeu_ps(data + i, _mm_add_ps(_mm_mul_ps(v, s), zero));
+        }
+
+        for (; i < numSamples; i++)
+            data[i] = tailSample<withNoise, gainRamp>(data[i], noise, gains, noiseGain, i, levels, step);
+    }
+
+    template <bool withNoise, bool gainRamp>
+    static void quantizeSSE2(float* data, const float* noise, const float* gains, float noiseGain, int numSamples,
+                             float levels, float step)
+    {
+        //SSE2 has no truncate instruction, so go through int32. That only works below 2^31,
+        //and any float at or above 2^23 is already a whole number, so those lanes are kept as they are
+        const __m128 l = _mm_set1_ps(levels);
+        const __m128 s = _mm_set1_ps(step);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 bigValue = _mm_set1_ps(8388608.0f);
+        const __m128 g = _mm_set1_ps(noiseGain);
+
+        int i = 0;
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            __m128 v = _mm_loadu_ps(data + i);
+
+            if (withNoise)
+            {
+                const __m128 gain = gainRamp ? _mm_loadu_ps(gains + i) : g;
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(noise + i), gain), v));
+            }
+
+            v = _mm_mul_ps(v, l);
+            __m128 isBig = _mm_cmpge_ps(_mm_and_ps(v, absMask), bigValue);
+            __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+            v = _mm_or_ps(_mm_and_ps(isBig, v), _mm_andnot_ps(isBig, truncated));
+            _mm_storeu_ps(data + i, _mm_add_ps(_mm_mul_ps(v, s), zero));
+        }
+
+        for (; i < numSamples; i++)
+            data[i] = tailSample<withNoise, gainRamp>(data[i], noise, gains, noiseGain, i, levels, step);
+    }
+   #elif JUCE_ARM && JUCE_64BIT
+    template <bool withNoise, bool gainRamp>
+    static void quantizeNEON(float* data, const float* noise, const float* gains, float noiseGain, int numSamples,
+                             float levels, float step)
+    {
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+
+        int i = 0;
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            float32x4_t v = vld1q_f32(data + i);
+
+            //Kept as separate multiply and add (not vmla) so the rounding matches the scalar path
+            if (withNoise)
+            {
+                const float32x4_t n = vld1q_f32(noise + i);
+                v = vaddq_f32(v, vmulq_f32(gainRamp ? vmulq_f32(n, vld1q_f32(gains + i)) : vmulq_n_f32(n, noiseGain), v));
+            }
+
+            v = vrndq_f32(vmulq_n_f32(v, levels));
+            vst1q_f32(data + i, vaddq_f32(vmulq_n_f32(v, step), zero));
+        }
+
+        for (; i < numSamples; i++)
+            data[i] = tailSample<withNoise, gainRamp>(data[i], noise, gains, noiseGain, i, levels, step);
+    }
+   #endif
+
+    //No noise, noise with a steady gain, noise with a gain ramp
+    Kernel vectorKernels[3] = { nullptr, nullptr, nullptr };
+    const char* kernelName = "Scalar";
+
+    float levels = 1.0f;
+    float step = 1.0f;
+    bool isPowerOfTwo = true;
+};
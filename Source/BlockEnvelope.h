@@ -0,0 +1,194 @@
+/*
+  ==============================================================================
+
+    BlockEnvelope.h
+    Created: 17 Oct 2026 7:05:11pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <limits>
+
+/**
+ The ADSR of the voice bank, worked out a stage at a time instead of a sample at a time.
+
+ juce::ADSR checks every sample whether its stage has reached its target. Here each stage is a "Segment": every sample the
+ level becomes level * multiply + add, and how many samples that goes on for is worked out when the stage starts. A linear
+ stage multiplies by 1 and adds a step. An exponential stage multiplies by less than 1, which pulls the level towards a
+ point a little past the target, so it gets to the target in the stage's time instead of only ever getting closer.
+
+ When a segment's samples are used up, the level is set to the target and the next stage starts. So a renderer runs plain
+ ramps and splits its block only where a stage ends (see "VoiceBank.h"). The end of the release is a known sample, and the
+ note is over right there.
+
+ The linear shape has the same rates as juce::ADSR. New parameters apply to the stages that start after them, apart from the
+ sustain level, which a sustaining note follows straight away as it does with juce::ADSR.
+ */
+class BlockEnvelope
+{
+public:
+    enum Stage
+    {
+        idle = 0,
+        attack,
+        decay,
+        sustain,
+        release
+    };
+
+    enum Shape
+    {
+        linear = 0,
+        exponential
+    };
+
+    /// The length of the stages that never end by themselves (sustain, idle)
+    static constexpr int forever = std::numeric_limits<int>::max();
+
+    /// A stage, as a ramp. The level the ramp starts from is kept by the caller.
+    struct Segment
+    {
+        int stage = idle;
+        float multiply = 0.0f, add = 0.0f;
+
+        /// the level the stage ends on, set exactly once its samples are done
+        float target = 0.0f;
+
+        /// samples left in the stage
+        int length = forever;
+    };
+
+    void setSampleRate(double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+    }
+
+    void setParameters(const juce::ADSR::Parameters& newParams, Shape newShape)
+    {
+        params = newParams;
+        shape = newShape;
+    }
+
+    const juce::ADSR::Parameters& getParameters() const    { return params; }
+    Shape getShape() const                                  { return shape; }
+
+    /// The start of a note, from silence like juce::ADSR's reset() then noteOn(). Sets the level too.
+    Segment noteOn(float& level) const
+    {
+        level = 0.0f;
+        return enter(attack, level);
+    }
+
+    /// The release, from wherever the level is now
+    Segment noteOff(float& level) const
+    {
+        return enter(release, level);
+    }
+
+    /// Once a segment's length has run out: put the level on its target and start the next stage
+    Segment next(int stage, float target, float& level) const
+    {
+        level = target;
+
+        switch (stage)
+        {
+            case attack:    return enter(decay, level);
+            case decay:     return enter(sustain, level);
+            case release:   return enter(idle, level);
+            default:        return enter(stage, level);
+        }
+    }
+
+private:
+    /// The segment for a stage, starting at the level given. Stages with no samples are passed straight through.
+    Segment enter(int stage, float& level) const
+    {
+        Segment seg;
+
+        for (;;)
+        {
+            seg.stage = stage;
+
+            if (stage == sustain)
+            {
+                level = seg.target = params.sustain;
+                seg.multiply = 1.0f;
+                return seg;
+            }
+
+            if (stage == idle)
+            {
+                level = 0.0f;
+                return seg;
+            }
+
+            //Attack goes from 0 to 1, decay from 1 to the sustain, release from the level the note was let go at to 0
+            if (stage == attack)
+                makeRamp(seg, 0.0f, 1.0f, level, params.attack);
+            else if (stage == decay)
+                makeRamp(seg, 1.0f, params.sustain, level, params.decay);
+            else
+                makeRamp(seg, level, 0.0f, level, params.release);
+
+            if (seg.length > 0)
+                return seg;
+
+            level = seg.target;
+            stage = (stage == attack) ? decay : (stage == decay) ? sustain : idle;
+        }
+    }
+
+    /**
+     The ramp of a stage that goes from one level to another in a given time. A time of 0, or a level that is already at the
+     target, gives no samples at all.
+
+     @param from where the stage starts when it runs its whole time
+     @param to the target
+     @param level where the note is now, somewhere between the two
+     @param seconds the stage's time
+     */
+    void makeRamp(Segment& seg, float from, float to, float level, float seconds) const
+    {
+        const double numSamples = seconds * sampleRate;
+        const double distance = (double) to - (double) from;
+        double length = 0.0;
+
+        seg.target = to;
+
+        if (numSamples > 0.0 && distance != 0.0)
+        {
+            if (shape == linear)
+            {
+                //Same rate as juce::ADSR, and it stops on the first sample that reaches the target
+                const float rate = (float) (distance / numSamples);
+                seg.multiply = 1.0f;
+                seg.add = rate;
+                length = std::ceil(((double) to - (double) level) / rate);
+            }
+            else
+            {
+                //Heads for a point past the target by a share of the distance, and gets to the target after numSamples.
+                //A small share makes a steeper curve. The attack is kept rounder, or it would be most of the way up in its
+                //first few milliseconds
+                const double overshoot = distance > 0.0 ? 0.3 : 0.001;
+                const double aim = (double) to + overshoot * distance;
+                const double coefficient = std::pow(overshoot / (1.0 + overshoot), 1.0 / numSamples);
+                seg.multiply = (float) coefficient;
+                seg.add = (float) (aim * (1.0 - coefficient));
+
+                const double remaining = ((double) to - aim) / ((double) level - aim);
+                length = (remaining > 0.0 && remaining < 1.0) ? std::ceil(std::log(remaining) / std::log(coefficient)) : 0.0;
+            }
+        }
+
+        seg.length = (int) juce::jlimit(0.0, (double) (forever - 1), length);
+    }
+
+    juce::ADSR::Parameters params;
+    Shape shape = linear;
+    double sampleRate = 44100.0;
+};
@@ -10,56 +10,302 @@
 
 #pragma once
 
+#include <JuceHeader.h>
+#include <cmath>
+#include "DspArena.h"
 
-class DelayLine
+/**
+ The ways a DelayLine can read between samples. Each is a policy for the read kernel: DelayLine::process() picks one once
+ per block and runs a loop compiled for it, so there is no switch per sample.
+
+ A policy splits a delay into a whole number of samples back and coefficients for the fraction (design()), then reads one
+ sample from a pointer to the sample that many back (read()). The pointer can be indexed from -olderPoints to newerPoints.
+ */
+namespace DelayInterpolation
 {
-    
-public:
-    
+    enum Type
+    {
+        none = 0,
+        linear,
+        lagrange,
+        allpass,
+        numTypes
+    };
+
+    /// What design() works out for a delay time: used by read()
+    struct Coefficients
+    {
+        int offset = 1;                     // how many samples back read() starts
+        float h[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    };
+
+    /// ceil() of a delay. Delays are never below 1, so the int conversion can do it, with no call into the maths library:
+    /// the taps of a "MultiTapDelay" design at every sample
+    static inline int ceilOfDelay(float delay)
+    {
+        const int whole = (int) delay;
+        return (float) whole < delay ? whole + 1 : whole;
+    }
+
+    /// Rounds to the nearest sample. The cheapest, but a moving delay steps
+    struct None
+    {
+        static constexpr float minDelay = 1.0f;
+        static constexpr int olderPoints = 0, newerPoints = 0;
+
+        static void design(float delay, Coefficients& c)
+        {
+            c.offset = (int) (delay + 0.5f);
+        }
+
+        static inline float read(const float* x, const Coefficients&, float&)
+        {
+            return x[0];
+        }
+    };
+
+    /// Straight line between the two samples either side. Dulls the top end as the fraction moves towards a half
+    struct Linear
+    {
+        static constexpr float minDelay = 1.0f;
+        static constexpr int olderPoints = 0, newerPoints = 1;
+
+        static void design(float delay, Coefficients& c)
+        {
+            c.offset = ceilOfDelay(delay);
+
+            //x[0] is the older sample, and the read position is this far on from it to x[1]
+            const float remainder = (float) c.offset - delay;
+            c.h[0] = 1.0f - remainder;
+            c.h[1] = remainder;
+        }
+
+        static inline float read(const float* x, const Coefficients& c, float&)
+        {
+            return c.h[0] * x[0] + c.h[1] * x[1];
+        }
+    };
+
+    /// 3rd order Lagrange through the two samples either side: a 4 point FIR with a much flatter top end than linear
+    struct Lagrange
+    {
+        static constexpr float minDelay = 2.0f;
+        static constexpr int olderPoints = 1, newerPoints = 2;
+
+        static void design(float delay, Coefficients& c)
+        {
+            c.offset = ceilOfDelay(delay);
+
+            //The points are at -1, 0, 1 and 2, and the read position at t. The products they share are worked out once, and
+            //there are no divides: a "MultiTapDelay" designs this at every sample
+            const float t = (float) c.offset - delay;
+            const float a = t * (t - 1.0f), b = (t + 1.0f) * (t - 2.0f);
+
+            c.h[0] = a * (t - 2.0f) * (-1.0f / 6.0f);
+            c.h[1] = b * (t - 1.0f) * 0.5f;
+            c.h[2] = b * t * -0.5f;
+            c.h[3] = a * (t + 1.0f) * (1.0f / 6.0f);
+        }
+
+        static inline float read(const float* x, const Coefficients& c, float&)
+        {
+            return c.h[0] * x[-1] + c.h[1] * x[0] + c.h[2] * x[1] + c.h[3] * x[2];
+        }
+    };
+
     /**
-     IMPORTANT. We didn't cover this in the class, but we need
-     to make sure we clean up the dynamically allocated array
-     when our object is destroyed!
+     1st order Thiran allpass: flat magnitude at every fraction, so nothing is dulled, but it has a state and so runs one
+     sample after another. The fraction is kept between 0.5 and 1.5 samples, where the filter behaves best. Best for a
+     delay that holds still: when it jumps the state has to catch up
      */
-    ~DelayLine()
+    struct Allpass
+    {
+        static constexpr float minDelay = 1.5f;
+        static constexpr int olderPoints = 1, newerPoints = 0;
+
+        static void design(float delay, Coefficients& c)
+        {
+            c.offset = (int) (delay - 0.5f);
+
+            const float fraction = delay - (float) c.offset;
+            c.h[0] = (1.0f - fraction) / (1.0f + fraction);
+        }
+
+        static inline float read(const float* x, const Coefficients& c, float& state)
+        {
+            state = c.h[0] * (x[0] - state) + x[-1];
+            return state;
+        }
+    };
+}
+
+/**
+ A ring buffer whose size is a power of two, so positions in it wrap with a mask. Only the writes are here: readers index
+ getBuffer() themselves, from as many places as they like, so several delays (e.g. the taps of a "MultiTapDelay") can
+ share one buffer.
+
+ The buffer has copies of its last sample before the start and of its first two after the end, so a read of the points
+ around any index, as every DelayInterpolation does, never has to wrap.
+ */
+class DelayBuffer
+{
+public:
+    /// the copies around the buffer: enough for the points of every interpolation
+    static constexpr int guardBefore = 1, guardAfter = 2;
+
+    /// Takes a cleared buffer from the arena, at least minSize samples long: call from prepareToPlay
+    void setSize(int minSize, DspArena& arena)
+    {
+        size = juce::nextPowerOfTwo(juce::jmax(2, minSize));
+        mask = size - 1;
+
+        data = arena.allocate<float>((size_t) (guardBefore + size + guardAfter));
+        writeIndex = 0;
+    }
+
+    void clear()
     {
-        if (data != nullptr)
-            delete[] data;
+        std::fill(data, data + guardBefore + size + guardAfter, 0.0f);
+    }
+
+    int getSize() const         { return size; }
+    int getMask() const         { return mask; }
+
+    /// where the next sample goes. The newest sample is one before it
+    int getWriteIndex() const   { return writeIndex; }
+
+    /// sample 0 of the buffer. Can be read from -guardBefore to getSize() + guardAfter - 1
+    const float* getBuffer() const
+    {
+        return data + guardBefore;
+    }
+
+    void write(float sample)
+    {
+        data[(size_t) (guardBefore + writeIndex)] = sample;
+        updateGuards(writeIndex, 1);
+
+        writeIndex = (writeIndex + 1) & mask;
     }
+
+    /// write numSamples samples, as one or two contiguous spans. The samples come from source (i) for i from 0 up
+    template <typename Source>
+    void write(int numSamples, Source source)
+    {
+        float* buffer = data + guardBefore;
+
+        for (int done = 0; done < numSamples;)
+        {
+            const int num = juce::jmin(numSamples - done, size - writeIndex);
+            float* dest = buffer + writeIndex;
+
+            for (int i = 0; i < num; i++)
+                dest[i] = source(done + i);
+
+            updateGuards(writeIndex, num);
+
+            done += num;
+            writeIndex = (writeIndex + num) & mask;
+        }
+    }
+
+    void write(const float* samples, int numSamples)
+    {
+        write(numSamples, [samples] (int i) { return samples[i]; });
+    }
+
+private:
+    /// after writing num samples from start: refresh the copies of any of them the guards hold
+    void updateGuards(int start, int num)
+    {
+        float* buffer = data + guardBefore;
+
+        if (start < guardAfter)
+            for (int i = start; i < juce::jmin(guardAfter, start + num); i++)
+                buffer[size + i] = buffer[i];
+
+        if (start + num > size - guardBefore)
+            for (int i = juce::jmax(start, size - guardBefore); i < start + num; i++)
+                buffer[i - size] = buffer[i];
+    }
+
+    float* data = nullptr;      // the guard copies around a power of two, in the arena
+
+    int size = 0;
+    int mask = -1;
+    int writeIndex = 0;
+};
+
+/**
+ A delay line with feedback, on a DelayBuffer. The delay can be fractional, read in any of the DelayInterpolation ways.
+
+ process() also takes a whole block. When the delay is longer than the block, every sample the block reads was written
+ before the block started: then the reads go first, as one or two contiguous spans, and the writes after them. Apart from
+ the allpass, both loops vectorize. A shorter delay reads samples written in the same block, so it goes one sample at a
+ time.
+ */
+class DelayLine
+{
+    
+public:
     
-    /// set the maximum size of the delay line
-    void setSizeInSamples(int newSize)
+    /// set the longest delay the line can hold, in samples. Takes the cleared line from the arena: call from prepareToPlay
+    void setSizeInSamples(int maxDelay, DspArena& arena)
     {
-        size = newSize;             // store the new size
+        buffer.setSize(maxDelay + 1, arena);
+        allpassState = 0.0f;
         
-        // free up existing data
-        if (data != nullptr)
-            delete[] data;
-        
-        data = new float[size];     // initialise our array
+        setDelayTimeInSamples(delayTime);
+    }
         
-        // set all values to zero
-        for (int i=0; i<size; i++)
-        {
-            data[i] = 0.0;
-        }
+    /// Silence the line, keeping its size and delay
+    void clear()
+    {
+        buffer.clear();
+        allpassState = 0.0f;
     }
     
+    int getMaxDelayInSamples() const
+    {
+        return buffer.getSize() - 1;
+    }
     
-    /// set the delay time in samples
+    /// set the delay time in samples, from 1 (or the interpolation's minDelay) up to getMaxDelayInSamples()
     void setDelayTimeInSamples(float newDelayTime)
     {
         delayTime = newDelayTime;
         
-        // set the read index to be behind the write index
-        readIndex = writeIndex - delayTime;
-        
-        if (readIndex < 0)
-            readIndex = readIndex + size;
-        
+        switch (interpolation)
+        {
+            case DelayInterpolation::none:      design<DelayInterpolation::None>(); break;
+            case DelayInterpolation::lagrange:  design<DelayInterpolation::Lagrange>(); break;
+            case DelayInterpolation::allpass:   design<DelayInterpolation::Allpass>(); break;
+            case DelayInterpolation::linear:
+            default:                            design<DelayInterpolation::Linear>(); break;
+        }
     }
     
+    float getDelayTimeInSamples() const
+    {
+        return delayTime;
+    }
     
+    /// choose how to read between samples. Can be changed at any time
+    void setInterpolation(DelayInterpolation::Type newInterpolation)
+    {
+        if (newInterpolation == interpolation)
+            return;
+
+        interpolation = newInterpolation;
+        allpassState = 0.0f;
+        setDelayTimeInSamples(delayTime);
+    }
+
+    DelayInterpolation::Type getInterpolation() const
+    {
+        return interpolation;
+    }
+
     
     /// call every sample to:
     ///--  store the new sample
@@ -67,57 +313,35 @@ public:
     ///-- return the value at the read index
     float process(float inputSample)
     {
-        // get value of data at green read index
-        float outputSample = linearInterpolation();// data[readIndex];
-        
-        // store value at red write index
-        data[writeIndex] = inputSample  +  outputSample * feedback;
-        
-    
-        // advance the read and write indexes
-        // wrap them back into the correct range
-        readIndex += 1;
-        if (readIndex >= size)
-            readIndex -= size;
-        
-        writeIndex += 1;
-        if (writeIndex >= size)
-            writeIndex -= size;
-        
-        
-        return outputSample;
-        
+        switch (interpolation)
+        {
+            case DelayInterpolation::none:      return processSample<DelayInterpolation::None>(inputSample);
+            case DelayInterpolation::lagrange:  return processSample<DelayInterpolation::Lagrange>(inputSample);
+            case DelayInterpolation::allpass:   return processSample<DelayInterpolation::Allpass>(inputSample);
+            case DelayInterpolation::linear:
+            default:                            return processSample<DelayInterpolation::Linear>(inputSample);
+        }
     }
     
+    /**
+     process a block: the same samples as calling process() for each one. Picks the read kernel once for the whole block
     
-    float linearInterpolation()
+     @param in the input. Can't be the same memory as out
+     @param out where the delayed samples go
+     */
+    void process(const float* in, float* out, int numSamples)
     {
-        // readIndex = 2.3;
-        
-        // get the two indexes around our read index
-        int indexA = int(readIndex);        // e.g. 2
-        int indexB = indexA + 1;            // e.g. 3
-        
-        // wrap indexB if necessary
-        if (indexB > size)
-            indexB -= size;
-        
-        // get values at data indexes
-        float valA = data[indexA];          // e.g. data[2]
-        float valB = data[indexB];          // e.g. data[3]
-        
-        
-        // calculate remainder
-        float remainder = readIndex - indexA;   // e.g. 2.3 - 2 = 0.3
-        
-        // work out interpolated sample between two indexes
-        float interpolatedSample = (1-remainder) * valA   +   remainder * valB;
-        
-        
-        return interpolatedSample;
+        switch (interpolation)
+        {
+            case DelayInterpolation::none:      processBlock<DelayInterpolation::None>(in, out, numSamples); break;
+            case DelayInterpolation::lagrange:  processBlock<DelayInterpolation::Lagrange>(in, out, numSamples); break;
+            case DelayInterpolation::allpass:   processBlock<DelayInterpolation::Allpass>(in, out, numSamples); break;
+            case DelayInterpolation::linear:
+            default:                            processBlock<DelayInterpolation::Linear>(in, out, numSamples); break;
+        }
     }
-    
-    
+
+
     void setFeedback(float _feedback)
     {
         feedback = _feedback;
@@ -126,21 +350,76 @@ public:
         if (feedback > 1.0)
             feedback = 1.0;
     }
-    
-    
-    
-    
+
+
+
+
 private:
+
+    template <typename Interpolation>
+    void design()
+    {
+        delayTime = juce::jlimit(Interpolation::minDelay, (float) getMaxDelayInSamples(), delayTime);
+        Interpolation::design(delayTime, coefficients);
+    }
+
+    template <typename Interpolation>
+    float processSample(float inputSample)
+    {
+        const float* x = buffer.getBuffer() + ((buffer.getWriteIndex() - coefficients.offset) & buffer.getMask());
+        const float outputSample = Interpolation::read(x, coefficients, allpassState);
+
+        buffer.write(inputSample + outputSample * feedback);
+
+        return outputSample;
+    }
+
+    template <typename Interpolation>
+    void processBlock(const float* in, float* out, int numSamples)
+    {
+        //The newest point read has to be from before the block
+        if (coefficients.offset - Interpolation::newerPoints < numSamples)
+        {
+            for (int i = 0; i < numSamples; i++)
+                out[i] = processSample<Interpolation>(in[i]);
+
+            return;
+        }
+        
+        //The reads first. Copied into locals so the stores to out don't make them reload
+        const float* source = buffer.getBuffer();
+        const DelayInterpolation::Coefficients c = coefficients;
+        const int size = buffer.getSize(), mask = buffer.getMask();
+        float state = allpassState;
+        int readIndex = (buffer.getWriteIndex() - c.offset) & mask;
+        
+        for (int done = 0; done < numSamples;)
+        {
+            //Up to the end of the buffer. The copies past the end cover the newer points of the last ones
+            const int num = juce::jmin(numSamples - done, size - readIndex);
+            const float* x = source + readIndex;
+            float* dest = out + done;
+        
+            for (int i = 0; i < num; i++)
+                dest[i] = Interpolation::read(x + i, c, state);
+        
+            done += num;
+            readIndex = (readIndex + num) & mask;
+        }
+        
+        allpassState = state;
+
+        //Then the writes, with the feedback
+        const float fb = feedback;
+        buffer.write(numSamples, [in, out, fb] (int i) { return in[i] + out[i] * fb; });
+    }
     
-    float readIndex = 0;  // read position as an index
-    int writeIndex = 0; // write position as an index
-    
-    int size;           // maximum possible delay time
-    
-    float* data = nullptr;        // store input audio data
-    
-    int delayTime;      // delay time in samples
+    DelayBuffer buffer;         // store input audio data: a power of two, one more than the longest delay
     
+    float delayTime = 1.0f;     // delay time in samples
+    DelayInterpolation::Type interpolation = DelayInterpolation::linear;
+    DelayInterpolation::Coefficients coefficients;
+    float allpassState = 0.0f;  // the allpass's last output
     
     float feedback = 0;     // must be between 0 and 1!!!
     
@@ -0,0 +1,137 @@
+/*
+  ==============================================================================
+
+    DspArena.h
+    Created: 18 Oct 2026 12:41:07am
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ One slab of memory for all of an instance's DSP: the delay buffers, the scratch spans, the ramps. It is allocated in
+ prepareToPlay and handed out in cache line aligned pieces, so the audio thread never goes to the heap, and what one block
+ touches sits together rather than scattered wherever the allocator put each module's vectors.
+
+ The modules say how much they want by asking for it, so there is no second sum of their sizes to keep up to date.
+ prepareToPlay prepares them twice:
+
+ - after beginLayout(), allocate() gives every span memory of its own and adds up what the slab needs
+ - allocateSlab() makes the slab (only when it has to grow) and frees the layout's spans
+ - the same modules are prepared again, in the same order, and get their spans from the slab
+
+ The spans are zeroed, or default constructed with construct(). They are only valid until the next beginLayout(), and
+ hold plain data: nothing in the arena is ever destroyed. The render check counts the heap allocations processBlock makes,
+ and expects none.
+ */
+class DspArena
+{
+public:
+    /// Every span starts on a cache line
+    static constexpr size_t alignment = 64;
+
+    /// Start the layout pass. Every span handed out before is gone
+    void beginLayout()
+    {
+        layingOut = true;
+        used = 0;
+        spareSpans.clear();
+    }
+
+    /// End the layout pass with one allocation for everything it asked for. Then prepare the same modules again
+    void allocateSlab()
+    {
+        jassert(layingOut);
+
+        if (used > capacity)
+        {
+            slabStorage.reset(new char[used + alignment]);
+            slab = align(slabStorage.get());
+            capacity = used;
+        }
+
+        spareSpans.clear();
+        layingOut = false;
+        used = 0;
+    }
+
+    /// A zeroed span of count Ts. Only from prepareToPlay
+    template <typename T>
+    T* allocate(size_t count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+                      "The arena zeroes its spans and never destroys them, so it can only hold plain data");
+
+        const size_t bytes = getBytesFor<T>(count);
+
+        if (layingOut || used + bytes > capacity)
+        {
+            //A module that asks for more after the layout than during it is prepared differently the second time. It gets
+            //memory of its own, so nothing breaks, but it isn't in the slab
+            jassert(layingOut);
+
+            if (layingOut)
+                used += bytes;
+
+            spareSpans.emplace_back(new char[bytes + alignment]);
+            char* span = align(spareSpans.back().get());
+            std::memset(span, 0, bytes);
+            return reinterpret_cast<T*>(span);
+        }
+
+        char* span = slab + used;
+        std::memset(span, 0, bytes);
+        used += bytes;
+
+        return reinterpret_cast<T*>(span);
+    }
+
+    /// A span of count default constructed Ts, for classes whose members start at something other than 0. Only from
+    /// prepareToPlay
+    template <typename T>
+    T* construct(size_t count)
+    {
+        T* span = allocate<T>(count);
+
+        for (size_t i = 0; i < count; i++)
+            new (span + i) T();
+
+        return span;
+    }
+
+    /// The bytes count Ts take in the arena, rounded up to whole cache lines
+    template <typename T>
+    static constexpr size_t getBytesFor(size_t count)
+    {
+        return (count * sizeof(T) + alignment - 1) & ~(alignment - 1);
+    }
+
+    /// The size of the slab, in bytes
+    size_t getSize() const
+    {
+        return capacity;
+    }
+
+private:
+    static char* align(char* memory)
+    {
+        return reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(memory) + alignment - 1) & ~(std::uintptr_t) (alignment - 1));
+    }
+
+    std::unique_ptr<char[]> slabStorage;
+    char* slab = nullptr;
+    size_t capacity = 0, used = 0;
+    bool layingOut = false;
+
+    //The layout pass's spans, or any that didn't fit in the slab
+    std::vector<std::unique_ptr<char[]>> spareSpans;
+};
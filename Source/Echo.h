@@ -0,0 +1,141 @@
+/*
+  ==============================================================================
+
+    Echo.h
+    Created: 17 Oct 2026 10:03:26pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DelayLine.h"
+#include "ParamSmoother.h"
+#include "DspArena.h"
+
+/**
+ A feedback echo on every channel, added to the signal in place after the crusher. Each channel has its own "DelayLine",
+ rendered a block at a time into a scratch span and then mixed in.
+
+ The time can follow the host's tempo: see getSyncedSeconds(). With the mix at 0 nothing runs at all, and the lines are
+ cleared when it comes back, so an old tail never plays.
+ */
+class Echo
+{
+public:
+    /// The longest echo. Enough for a bar of 4/4 at 60 BPM
+    static constexpr double maxSeconds = 4.0;
+
+    /// The note lengths the echo can sync to, in the order of the "Echo Division" parameter
+    static juce::StringArray getDivisionNames()
+    {
+        return { "1/16", "1/8 T", "1/8", "1/8 D", "1/4 T", "1/4", "1/4 D", "1/2", "1 Bar" };
+    }
+
+    /// The length of a division at a tempo, in seconds
+    static double getSyncedSeconds(int division, double beatsPerMinute)
+    {
+        static const double beats[] = { 0.25, 1.0 / 3.0, 0.5, 0.75, 2.0 / 3.0, 1.0, 1.5, 2.0, 4.0 };
+        const int index = juce::jlimit(0, (int) (sizeof(beats) / sizeof(beats[0])) - 1, division);
+
+        return beats[index] * 60.0 / juce::jmax(1.0, beatsPerMinute);
+    }
+
+    /// How long the echo rings on after its input stops: until its repeats have died away by 60 dB
+    static double getTailSeconds(double delaySeconds, float feedback)
+    {
+        if (feedback <= 0.0f)
+            return delaySeconds;
+
+        const double repeats = std::ceil(std::log(0.001) / std::log((double) juce::jmin(feedback, 0.999f)));
+        return delaySeconds * (1.0 + repeats);
+    }
+
+    /// Takes the lines and the scratch span from the arena: call from prepareToPlay
+    void prepare(double newSampleRate, int numChannels, int maxBlockSize, DspArena& arena)
+    {
+        sampleRate = newSampleRate;
+        numLines = juce::jmax(1, numChannels);
+        lines = arena.construct<DelayLine>((size_t) numLines);
+
+        for (int chan = 0; chan < numLines; chan++)
+            lines[chan].setSizeInSamples((int) std::ceil(maxSeconds * sampleRate), arena);
+
+        wetSize = juce::jmax(1, maxBlockSize);
+        wet = arena.allocate<float>((size_t) wetSize);
+        running = false;
+    }
+
+    /// Set once per block. The time jumps, it isn't glided
+    void setDelayTime(double seconds)
+    {
+        for (int chan = 0; chan < numLines; chan++)
+            lines[chan].setDelayTimeInSamples((float) (seconds * sampleRate));
+    }
+
+    /// How the lines read between samples, e.g. DelayInterpolation::allpass for repeats that stay bright
+    void setInterpolation(DelayInterpolation::Type interpolation)
+    {
+        for (int chan = 0; chan < numLines; chan++)
+            lines[chan].setInterpolation(interpolation);
+    }
+
+    /// How much of the echo goes back into the line, 0 to 1. Set once per block
+    void setFeedback(float feedback)
+    {
+        for (int chan = 0; chan < numLines; chan++)
+            lines[chan].setFeedback(feedback);
+    }
+
+    /**
+     Add the echo to the channels in place
+
+     @param startSample first sample of the channels to process
+     @param mix the level of the echo, from the start of the block. A steady 0 turns the echo off
+     */
+    void process(float* const* channels, int numChannels, int startSample, int numSamples, const SmoothedSpan& mix)
+    {
+        if (! mix.isRamping() && mix.value <= 0.0f)
+        {
+            running = false;
+            return;
+        }
+
+        if (! running)
+        {
+            for (int chan = 0; chan < numLines; chan++)
+                lines[chan].clear();
+
+            running = true;
+        }
+
+        const int numEchoed = juce::jmin(numChannels, numLines);
+        const int chunkSize = wetSize;
+
+        for (int chan = 0; chan < numEchoed; chan++)
+        {
+            for (int start = 0; start < numSamples; start += chunkSize)
+            {
+                const int num = juce::jmin(chunkSize, numSamples - start);
+                float* data = channels[chan] + startSample + start;
+                const SmoothedSpan level = mix.from(startSample + start);
+
+                lines[chan].process(data, wet, num);
+
+                if (level.isRamping())
+                    juce::FloatVectorOperations::addWithMultiply(data, wet, level.ramp, num);
+                else
+                    juce::FloatVectorOperations::addWithMultiply(data, wet, level.value, num);
+            }
+        }
+    }
+
+private:
+    DelayLine* lines = nullptr;
+    int numLines = 0;
+    float* wet = nullptr;
+    int wetSize = 0;
+    double sampleRate = 44100.0;
+    bool running = false;
+};
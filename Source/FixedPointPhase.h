@@ -0,0 +1,89 @@
+/*
+  ==============================================================================
+
+    FixedPointPhase.h
+    Created: 17 Oct 2026 4:08:33pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+/**
+ Set ALPACON_PHASE_BITS to 32 or 64 (in the Projucer's preprocessor definitions) to run every oscillator in
+ "Oscillators.h" and "Wavetable.h", and the sample-and-hold clock, on integer phase accumulators. Leave it at 0 for the
+ float ones.
+
+ A float phase loses precision as it gets near 1 and picks up a little rounding every time it wraps, so over hours the
+ pitch and phase wander. An integer phase counts whole fractions of a cycle: 2^32 or 2^64 of them. Adding the increment is
+ exact, the wrap is the free overflow of the unsigned type, and a table index is just the top bits. With 32 bits the pitch
+ is good to 1e-5 Hz at 44.1kHz, with 64 bits to far below anything audible. Only the increment is ever rounded, once, when
+ the frequency is set.
+ */
+#ifndef ALPACON_PHASE_BITS
+ #define ALPACON_PHASE_BITS 0
+#endif
+
+#if ALPACON_PHASE_BITS != 0 && ALPACON_PHASE_BITS != 32 && ALPACON_PHASE_BITS != 64
+ #error "ALPACON_PHASE_BITS must be 0, 32 or 64"
+#endif
+
+/**
+ The integer phase types and the conversions to and from cycles
+ */
+struct FixedPointPhase
+{
+   #if ALPACON_PHASE_BITS == 64
+    using Phase = uint64_t;
+    using Clock = int64_t;
+    static constexpr int bits = 64;
+   #else
+    using Phase = uint32_t;
+    using Clock = int32_t;
+    static constexpr int bits = 32;
+   #endif
+
+    /// The sample-and-hold clock counts samples with half the bits as fraction: 16.16 or 32.32
+    static constexpr int clockFractionBits = bits / 2;
+
+    /// A phase or an increment, in cycles, as a fraction of a whole cycle. Only the fractional part is kept.
+    static Phase fromCycles(double cycles)
+    {
+        cycles -= std::floor(cycles);
+
+        //Rounding can land exactly on a whole cycle, which doesn't fit in the type. It is the same as no phase at all.
+        const double scaled = std::ldexp(cycles, bits);
+        return scaled >= std::ldexp(1.0, bits) ? 0 : (Phase) scaled;
+    }
+
+    /**
+     A phase offset in cycles, either way, to add to a phase: for phase modulation, at every sample. Good to 2^-30 of a
+     cycle, and for offsets under 2^31 cycles. Goes through a 32 bit int, so a loop of these vectorizes.
+     */
+    static inline Phase fromOffset(float cycles)
+    {
+        const float fraction = cycles - (float) (int32_t) cycles;
+        return (Phase) (Clock) (int32_t) (fraction * 1073741824.0f) << (bits - 30);
+    }
+
+    /// Back to cycles (0 up to but not including 1). Uses the top 24 bits, so the float is exact.
+    static inline float toCycles(Phase p)
+    {
+        return (float) (uint32_t) (p >> (bits - 24)) * (1.0f / 16777216.0f);
+    }
+
+    /// The top 32 bits, for table lookups. The index is a shift of this and the rest is the interpolation fraction.
+    static inline uint32_t top32(Phase p)
+    {
+        return (uint32_t) (p >> (bits - 32));
+    }
+
+    /// Samples (e.g. a sample-and-hold ratio) as a fixed-point clock value
+    static Clock clockFromSamples(double samples)
+    {
+        return (Clock) std::llround(std::ldexp(samples, clockFractionBits));
+    }
+};
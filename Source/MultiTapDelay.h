@@ -0,0 +1,377 @@
+/*
+  ==============================================================================
+
+    MultiTapDelay.h
+    Created: 17 Oct 2026 11:24:51pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DelayLine.h"
+#include "DspArena.h"
+#include "Oscillators.h"
+#include "ParamSmoother.h"
+
+/**
+ Chorus, flanger and tape wow and flutter: short delays swept by a sine LFO, mixed with the dry signal in place.
+
+ Every channel has one "DelayBuffer", written once per block, and all the taps read from it. So a tap costs its reads
+ and nothing else: no buffer of its own to fill and keep in cache. The taps are spread around the LFO's cycle, so they
+ never line up. The LFO is a pair of "SinOsc"s a quarter cycle apart, and each tap's sine is a fixed mix of the two, so
+ the oscillators cost the same however many taps there are. As with the detune LFO in "VoiceBank", they run at a
+ control rate on a clock of their own, joined up with straight lines, so the sweep is the same whatever the block size.
+
+ The block is written before any tap reads it, so a tap can be shorter than the block. There is no feedback.
+
+ The taps move at every sample, so their reads work out the DelayInterpolation coefficients at every sample too. The
+ interpolation is picked once per block, as in "DelayLine". Lagrange by default, which keeps the top end of a moving
+ read.
+ */
+class MultiTapDelay
+{
+public:
+    enum Mode
+    {
+        chorus = 0,
+        flanger,
+        tape,
+        numModes
+    };
+
+    static constexpr int maxTaps = 8;
+
+    /// The longest a tap can be: the chorus at its widest
+    static constexpr double maxSeconds = 0.025;
+
+    /// The modes, in the order of the "Mod Mode" parameter
+    static juce::StringArray getModeNames()
+    {
+        return { "Chorus", "Flanger", "Tape" };
+    }
+
+    /// Takes the buffers and the scratch spans from the arena: call from prepareToPlay
+    void prepare(double newSampleRate, int numChannels, int maxBlockSize, DspArena& arena)
+    {
+        sampleRate = newSampleRate;
+        blockSize = juce::jmax(1, maxBlockSize);
+
+        //The oldest point a tap reads, for every sample of the block, has to still be there after the block is written
+        const int longest = (int) std::ceil(maxSeconds * sampleRate) + DelayBuffer::guardBefore + 1;
+
+        numBufferChannels = juce::jmax(1, numChannels);
+        buffers = arena.construct<DelayBuffer>((size_t) numBufferChannels);
+
+        for (int chan = 0; chan < numBufferChannels; chan++)
+            buffers[chan].setSize(longest + blockSize, arena);
+
+        const size_t numBuffers = (size_t) numBufferChannels;
+        tapDelays = arena.allocate<float>((size_t) (maxTaps * blockSize));
+        lfoCurves = arena.allocate<float>((size_t) (numCurves * blockSize));
+        wet = arena.allocate<float>(numBuffers * (size_t) blockSize);
+        allpassStates = arena.allocate<float>(numBuffers * maxTaps);
+
+        //Where each channel's taps read from and add up into
+        bufferData = arena.allocate<const float*>(numBuffers);
+        wetChannels = arena.allocate<float*>(numBuffers);
+
+        for (size_t chan = 0; chan < numBuffers; chan++)
+        {
+            bufferData[chan] = buffers[chan].getBuffer();
+            wetChannels[chan] = wet + chan * (size_t) blockSize;
+        }
+
+        updateTapPhases();
+
+        for (auto* osc : { &lfoSin, &lfoCos, &flutter })
+            osc->setSampleRate((float) (sampleRate / controlInterval));
+
+        lfoCos.setPhaseOffset(0.25f);
+
+        flutter.setFrequency(flutterRate);
+
+        //The first control point, so the curves start from where the oscillators are
+        SinOsc* oscs[numCurves] = { &lfoSin, &lfoCos, &flutter };
+
+        for (int k = 0; k < numCurves; k++)
+            controlTo[k] = oscs[k]->process();
+
+        samplesToControl = 0;
+
+        running = false;
+    }
+
+    void setMode(Mode newMode)
+    {
+        mode = newMode;
+    }
+
+    /// How many taps the chorus and flanger read. Tape is always one
+    void setNumTaps(int newNumTaps)
+    {
+        newNumTaps = juce::jlimit(1, maxTaps, newNumTaps);
+
+        if (newNumTaps == numTaps)
+            return;
+
+        numTaps = newNumTaps;
+        updateTapPhases();
+    }
+
+    /// The LFO rate in Hz. Set once per block
+    void setRate(float hz)
+    {
+        lfoSin.setFrequency(hz);
+        lfoCos.setFrequency(hz);
+    }
+
+    /// How far the LFO sweeps the taps, 0 to 1 of each mode's widest sweep
+    void setDepth(float newDepth)
+    {
+        depth = juce::jlimit(0.0f, 1.0f, newDepth);
+    }
+
+    /// How the taps read between samples
+    void setInterpolation(DelayInterpolation::Type newInterpolation)
+    {
+        interpolation = newInterpolation;
+    }
+
+    /**
+     Mix the delayed signal in, in place
+
+     @param startSample first sample of the channels to process
+     @param mix how much of the output is the taps rather than the dry signal, from the start of the block. A steady 0
+                turns it off
+     */
+    void process(float* const* channels, int numChannels, int startSample, int numSamples, const SmoothedSpan& mix)
+    {
+        if (! mix.isRamping() && mix.value <= 0.0f)
+        {
+            running = false;
+            return;
+        }
+
+        if (! running)
+        {
+            for (int chan = 0; chan < numBufferChannels; chan++)
+                buffers[chan].clear();
+
+            std::fill(allpassStates, allpassStates + numBufferChannels * maxTaps, 0.0f);
+            running = true;
+        }
+
+        for (int start = 0; start < numSamples; start += blockSize)
+        {
+            const int num = juce::jmin(blockSize, numSamples - start);
+            const int first = startSample + start;
+            const SmoothedSpan chunkMix = mix.from(first);
+
+            switch (interpolation)
+            {
+                case DelayInterpolation::none:      processChunk<DelayInterpolation::None>(channels, numChannels, first, num, chunkMix); break;
+                case DelayInterpolation::linear:    processChunk<DelayInterpolation::Linear>(channels, numChannels, first, num, chunkMix); break;
+                case DelayInterpolation::allpass:   processChunk<DelayInterpolation::Allpass>(channels, numChannels, first, num, chunkMix); break;
+                case DelayInterpolation::lagrange:
+                default:                            processChunk<DelayInterpolation::Lagrange>(channels, numChannels, first, num, chunkMix); break;
+            }
+        }
+    }
+
+private:
+    /// The flutter runs at a fixed rate, over the wow of the LFO
+    static constexpr float flutterRate = 7.3f;
+
+    /// Samples between the points where the oscillators are worked out. The LFO is 10 Hz at most
+    static constexpr int controlInterval = 16;
+
+    /// The curves the oscillators make: the LFO's sine and cosine, then the flutter
+    static constexpr int numCurves = 3;
+
+    /// Where each mode's taps sit, and how far the LFO sweeps them at full depth, in milliseconds
+    struct Sweep
+    {
+        float baseMs, widthMs;
+    };
+
+    Sweep getSweep() const
+    {
+        switch (mode)
+        {
+            case flanger:   return { 0.3f, 5.0f };
+            case tape:      return { 3.0f, 4.0f };
+            case chorus:
+            default:        return { 10.0f, 12.0f };
+        }
+    }
+
+    void updateTapPhases()
+    {
+        for (int tap = 0; tap < maxTaps; tap++)
+        {
+            const double angle = juce::MathConstants<double>::twoPi * tap / numTaps;
+            tapSin[tap] = (float) std::sin(angle);
+            tapCos[tap] = (float) std::cos(angle);
+        }
+    }
+
+    int getNumActiveTaps() const
+    {
+        return mode == tape ? 1 : numTaps;
+    }
+
+    /// Each tap's delay, in samples, for every sample of the chunk
+    template <typename Interpolation>
+    void renderTapDelays(int numSamples)
+    {
+        const Sweep sweep = getSweep();
+        const float msToSamples = (float) (sampleRate / 1000.0);
+
+        //The LFO is -1 to 1, so it goes round the middle of the sweep
+        const float halfWidth = 0.5f * depth * sweep.widthMs * msToSamples;
+        const float centre = juce::jmax(Interpolation::minDelay, sweep.baseMs * msToSamples) + halfWidth;
+
+        renderCurves(numSamples);
+
+        const float* sine = lfoCurves;
+        const float* cosine = sine + blockSize;
+
+        for (int tap = 0; tap < getNumActiveTaps(); tap++)
+        {
+            //sin (a + b) = sin a cos b + cos a sin b, with b the tap's place around the cycle
+            float* delays = tapDelays + tap * blockSize;
+            const float fromSine = halfWidth * tapCos[tap];
+            const float fromCosine = halfWidth * tapSin[tap];
+
+            for (int i = 0; i < numSamples; i++)
+                delays[i] = centre + fromSine * sine[i] + fromCosine * cosine[i];
+        }
+
+        if (mode == tape)
+        {
+            //A little fast flutter on the slow wow. It only ever adds to the delay, so it stays above the base
+            const float flutterWidth = 0.5f * depth * 0.3f * msToSamples;
+            float* delays = tapDelays;
+            const float* curve = lfoCurves + 2 * blockSize;
+
+            for (int i = 0; i < numSamples; i++)
+                delays[i] += flutterWidth * (1.0f + curve[i]);
+        }
+    }
+
+    /// The oscillators at every control point, and straight lines in between
+    void renderCurves(int numSamples)
+    {
+        SinOsc* oscs[numCurves] = { &lfoSin, &lfoCos, &flutter };
+
+        for (int done = 0; done < numSamples;)
+        {
+            if (samplesToControl == 0)
+            {
+                for (int k = 0; k < numCurves; k++)
+                {
+                    controlFrom[k] = controlTo[k];
+                    controlTo[k] = oscs[k]->process();
+                }
+
+                samplesToControl = controlInterval;
+            }
+
+            const int num = juce::jmin(numSamples - done, samplesToControl);
+            const int into = controlInterval - samplesToControl;
+
+            for (int k = 0; k < numCurves; k++)
+            {
+                float* curve = lfoCurves + k * blockSize + done;
+                const float from = controlFrom[k];
+                const float step = (controlTo[k] - from) * (1.0f / (float) controlInterval);
+
+                for (int i = 0; i < num; i++)
+                    curve[i] = from + step * (float) (into + i + 1);
+            }
+
+            done += num;
+            samplesToControl -= num;
+        }
+    }
+
+    template <typename Interpolation>
+    void processChunk(float* const* channels, int numChannels, int startSample, int numSamples, const SmoothedSpan& mix)
+    {
+        renderTapDelays<Interpolation>(numSamples);
+
+        const int numActive = getNumActiveTaps();
+        const float tapGain = 1.0f / (float) numActive;
+        const int numBuffers = juce::jmin(numChannels, numBufferChannels);
+
+        //The whole chunk goes in first, so the reads of every tap can run straight through it. The buffers are all
+        //written together, so they are all at the same place
+        const int firstIndex = buffers[0].getWriteIndex();
+        const int mask = buffers[0].getMask();
+
+        for (int chan = 0; chan < numBuffers; chan++)
+        {
+            buffers[chan].write(channels[chan] + startSample, numSamples);
+            juce::FloatVectorOperations::clear(wetChannels[chan], numSamples);
+        }
+
+        //A tap's coefficients only depend on its delay, so they are worked out once for every channel
+        const float* const* sources = bufferData;
+        float* const* outs = wetChannels;
+
+        for (int tap = 0; tap < numActive; tap++)
+        {
+            const float* delays = tapDelays + tap * blockSize;
+            float* states = allpassStates + tap * numBufferChannels;
+
+            for (int i = 0; i < numSamples; i++)
+            {
+                DelayInterpolation::Coefficients c;
+                Interpolation::design(delays[i], c);
+                const int index = (firstIndex + i - c.offset) & mask;
+
+                for (int chan = 0; chan < numBuffers; chan++)
+                    outs[chan][i] += Interpolation::read(sources[chan] + index, c, states[chan]);
+            }
+        }
+
+        //dry + mix * (taps - dry)
+        for (int chan = 0; chan < numBuffers; chan++)
+        {
+            float* data = channels[chan] + startSample;
+            float* out = outs[chan];
+
+            juce::FloatVectorOperations::multiply(out, tapGain, numSamples);
+            juce::FloatVectorOperations::subtract(out, data, numSamples);
+
+            if (mix.isRamping())
+                juce::FloatVectorOperations::addWithMultiply(data, out, mix.ramp, numSamples);
+            else
+                juce::FloatVectorOperations::addWithMultiply(data, out, mix.value, numSamples);
+        }
+    }
+
+    DelayBuffer* buffers = nullptr;
+    int numBufferChannels = 0;
+    float* tapDelays = nullptr;
+    float* lfoCurves = nullptr;
+    float* wet = nullptr;
+    float* allpassStates = nullptr;
+    const float** bufferData = nullptr;
+    float** wetChannels = nullptr;
+
+    SinOsc lfoSin, lfoCos, flutter;
+    float controlFrom[numCurves] = {}, controlTo[numCurves] = {};
+    int samplesToControl = 0;
+    float tapSin[maxTaps] = {}, tapCos[maxTaps] = {};
+
+    double sampleRate = 44100.0;
+    int blockSize = 1;
+    Mode mode = chorus;
+    int numTaps = 1;
+    float depth = 0.5f;
+    DelayInterpolation::Type interpolation = DelayInterpolation::lagrange;
+    bool running = false;
+};
@@ -11,6 +11,7 @@
 #pragma once
 
 #include "Oscillators.h"
+#include "VoiceBank.h"
 #include  "DelayLine.h"
 
 
@@ -43,66 +44,27 @@ public:
  @updated 2019-06-18
  
     Using "Synth" header file from Learn page as a basis to my "MySynth" file. I comment about every modification and extention I have.
+ 
+    The DSP of the voice lives in a slot of the shared "VoiceBank", so that all the voices render together in one loop. This
+    class keeps what juce::Synthesiser needs from a voice (note on, note off, finishing) and forwards the rest to the bank.
+    The synth wide parameters (detune, LFO) are set once for all voices on "MySynth". So is the routing of the voice's two
+    oscillators, the triangle and the detune sine: mixed, or one phase modulating the other.
  */
 class MySynthVoice : public juce::SynthesiserVoice
 {
 public:
-    MySynthVoice() {}
-    
-    //Set the Sample Rate & init the parameters for the ADSR
-    void init(float sampleRate)
-    {
-        //sampleRate
-        osc.setSampleRate(sampleRate);
-        detuneOsc.setSampleRate(sampleRate);
-        LFO.setSampleRate(sampleRate);
-        env.setSampleRate(sampleRate);
-        
-        //ADSR
-        /*
-         I didn't want a controllable ADSR since it is can be a noisy with the bitcrusher Synth. Rather, I wanted to have a decent
-         attack and decay parameters for smooth and unpoped sound.This is just to smoothen the sound.
-         */
-        juce::ADSR::Parameters envParams;
-        envParams.attack = 0.1;
-        envParams.decay = 0.2;
-        envParams.sustain = 0.1;
-        envParams.release = 0.1;
-        
-        env.setParameters(envParams);
-    }
-    
-    //This function is to switch the bool value @detuneIsOn to "true" or "false" ot turn on or off the detuning
-    void openDetune(float detuneOn)
-    {
-        if(detuneOn > 0.5f)
-        {
-            detuneIsOn = true;
-        }
-        else
-        {
-            detuneIsOn = false;
-        }
-    }
-    
-    //This function sets how much the second signal will be detuned from the original signal's freq
-    void setDetune(float detuneIn)
+    MySynthVoice(VoiceBank& voiceBank)
+        : bank(voiceBank),
+          voiceIndex(voiceBank.addVoice())
     {
-        detuneAmount = detuneIn;
     }
     
-    //To determine how much "detuned" sound the master sound will have with respect to the original "tuned" sound
-    void setDetuneMix(float mix)
+    //Level of this voice, set from the velocity of each note (see VoiceBank::setVelocitySensitivity())
+    void setGain(float gain)
     {
-        mixForDetune = mix;
+        bank.setGain(voiceIndex, gain);
     }
 
-    //Control the speed of the LFO which controls the detunining
-    void setLFOFreq(float freq)
-    {
-        LFO.setFrequency(freq);
-    }
-    
     //--------------------------------------------------------------------------
     /**
      What should be done when a note starts
@@ -114,13 +76,8 @@ public:
      */
     void startNote (int midiNoteNumber, float velocity, juce::SynthesiserSound*, int /*currentPitchWheelPosition*/) override
     {
-        playing = true;
-        ending = false;
-        freq = juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber);
-        osc.setFrequency(freq);
-        
-        env.reset();
-        env.noteOn();
+        setGain(bank.getVelocityGain(velocity));
+        bank.startNote(voiceIndex, (float) juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber));
         
     }
     //--------------------------------------------------------------------------
@@ -133,8 +90,7 @@ public:
      */
     void stopNote(float /*velocity*/, bool allowTailOff) override
     {
-        env.noteOff();
-        ending = true;
+        bank.stopNote(voiceIndex);
 //        clearCurrentNote();
 //        playing = false;
 
@@ -143,74 +99,26 @@ public:
     
     //--------------------------------------------------------------------------
     /**
-     The Main DSP Block: Put your DSP code in here
-     
-     If the sound that the voice is playing finishes during the course of this rendered block, it must call clearCurrentNote(), to tell the synthesiser that it has finished
+     The Main DSP Block. Nothing happens here: "MySynth" renders every voice at once from the voice bank, see renderVoices()
 
      @param outputBuffer pointer to output
      @param startSample position of first sample in buffer
      @param numSamples number of smaples in output buffer
      */
-    void renderNextBlock(juce::AudioSampleBuffer& outputBuffer, int startSample, int numSamples) override
+    void renderNextBlock(juce::AudioSampleBuffer& /*outputBuffer*/, int /*startSample*/, int /*numSamples*/) override
     {
-        if (playing) // check to see if this voice should be playing
-        {
-            
-            /*Set the detune osc's frequency. The frequency depends on the LFO's output. It is scaled with +1 and then
-            scaled with detuneAmount multiplied to have a good but not wierd range of osciallation that is still a detuned
-             sounds rather than another sound entirely different
-            */
-            detuneOsc.setFrequency(freq - ( (LFO.process() + 1.0f) * detuneAmount));
+    }
             
-            // iterate through the necessary number of samples (from startSample up to startSample + numSamples)
-            for (int sampleIndex = startSample;   sampleIndex < (startSample+numSamples);   sampleIndex++)
-            {
-                
-                // The ADSR Envelope values
-                float envVal = env.getNextSample();
-                
-                //The original "tuned" sound
-                float basicSample = osc.process();
-
-                //"Detuned" sound mixed with the original "tuned" sound. @mixForDetuen parameter control the mix
-                float detuneSample = (((osc.process())* (1.0f - mixForDetune) ) + ((detuneOsc.process()) * mixForDetune ));
-                
-                
-                // for each channel, write the currentSample float to the output
-                for (int chan = 0; chan<outputBuffer.getNumChannels(); chan++)
-                {
-                
-                    //If the user selects "detune" option as 1 through UI
-                    if(detuneIsOn)
-                    {
-                        //add a "detuned" + "tuned" sample modulated by ADSR Envelope and channel it thorugh the outputBuffer with
-                        //appropriate sampleIndex
-                        outputBuffer.addSample (chan, sampleIndex, detuneSample * envVal);
-                    }
-
-                    //If "detune" is not selected
-                    else
-                    {
-                        //add "tuned" sample modulated by ADSR Envelope and channel it thorugh the outputBuffer with
-                        //appropriate sampleIndex
-                        outputBuffer.addSample (chan, sampleIndex, basicSample * envVal);
-                    }
-                        
-                    
-                }
-                if(ending)
-                {
-                    //To stop the sound when the enveloped sound is finished. ATTENTION: Don't write envVal = 0 as it could never reach
-                    //zero sometimes
-                    if(envVal < 0.001f)
-                    {
-                        clearCurrentNote();
-                        playing = false;
-                    }
-                }
+    /// Called by "MySynth" once the envelope of this voice has died away, to tell the synthesiser that it has finished
+    void noteFinished()
+    {
+        clearCurrentNote();
+    }
                 
-            }
-        }
+    /// The number the bank knows this voice by. Voices are numbered in the order they are added to the synth.
+    int getVoiceIndex() const
+    {
+        return voiceIndex;
     }
     //--------------------------------------------------------------------------
     void pitchWheelMoved(int) override {}
@@ -230,29 +138,176 @@ public:
     //--------------------------------------------------------------------------
 private:
     //--------------------------------------------------------------------------
-    // Set up any necessary variables here
-    /// Should the voice be playing?
-    bool playing = false;
-    bool ending = false;
-
+    //The bank that holds this voice's DSP, and our number in it
+    VoiceBank& bank;
+    const int voiceIndex;
+};
+        
+        
+        
+// =================================
+// =================================
+// Synthesiser
+        
+/**
+ juce::Synthesiser with its voices' DSP in one "VoiceBank". The synthesiser still does the MIDI and the voice allocation,
+ renderVoices() renders every playing voice in one pass over the bank.
+ */
+class MySynth : public juce::Synthesiser
+{
+public:
+    /// Add the voices with this bank before calling prepare()
+    VoiceBank& getVoiceBank()
+    {
+        return bank;
+    }
     
-    // Bool to control the Detune on/off
-    bool detuneIsOn = false;
-
-    //To hold "Hertz" values from "MIDI" values
-    float freq;
+    const VoiceBank& getVoiceBank() const
+    {
+        return bank;
+    }
     
-    //Necessary Oscillators with Specific Duties
-    TriOsc osc;
-    SinOsc detuneOsc;
-    SinOsc LFO;
+    /// Call from prepareToPlay. The bank's scratch space comes from the arena
+    void prepare(double sampleRate, int maxBlockSize, DspArena& arena)
+    {
+        setCurrentPlaybackSampleRate(sampleRate);
+        bank.prepare(sampleRate, maxBlockSize, arena);
     
-    //The parameters for Detuning
-    float detuneAmount = 2.0f;
-    float mixForDetune;
+        //ADSR
+        /*
+         I wanted to have a decent attack and decay parameters for smooth and unpoped sound.This is just to smoothen the sound.
+         These are the defaults, the envelope parameters take over from the first block
+         */
+        setEnvelope(0.1f, 0.2f, 0.1f, 0.1f, BlockEnvelope::linear);
+    }
     
-    //ADSR
-    juce::ADSR env;
+    /// The ADSR of every voice, times in seconds. Nothing is worked out unless a value changes, so set it every block
+    void setEnvelope(float attack, float decay, float sustain, float release, BlockEnvelope::Shape shape)
+    {
+        juce::ADSR::Parameters envParams;
+        envParams.attack = attack;
+        envParams.decay = decay;
+        envParams.sustain = sustain;
+        envParams.release = release;
+    
+        bank.setEnvelope(envParams, shape);
+    }
+    
+    //--------------------------------------------------------------------------
+    //These used to be set on every voice, every block. They are the same for all voices, so now they are set once.
+    
+    //This function is to switch the detune to "true" or "false" ot turn on or off the detuning
+    void openDetune(float detuneOn)
+    {
+        bank.setDetuneOn(detuneOn > 0.5f);
+    }
+    
+    //This function sets how much the second signal will be detuned from the original signal's freq
+    void setDetune(float detuneIn)
+    {
+        bank.setDetune(detuneIn);
+    }
+    
+    //To determine how much "detuned" sound the master sound will have with respect to the original "tuned" sound.
+    //Steady or smoothed over the block (see "ParamSmoother.h")
+    void setDetuneMix(const SmoothedSpan& mix)
+    {
+        bank.setDetuneMix(mix);
+    }
+    
+    //Control the speed of the LFO which controls the detunining, steady or smoothed too
+    void setLFOFreq(const SmoothedSpan& freq)
+    {
+        bank.setLFOFrequency(freq);
+    }
+    
+    //The LFO is worked out every few samples and smoothed in between. This works it out at every sample, for fast rates
+    void setLFOAudioRate(bool audioRate)
+    {
+        bank.setLFOAudioRate(audioRate);
+    }
+    
+    /**
+     Unison for the notes that start from now on: how many copies, how far apart they are tuned (in cents) and panned
+     (0-1), and how scattered their start phases are (0-1). A note in unison takes one voice's worth of DSP per copy.
+     */
+    void setUnison(int numCopies, float spreadCents, float width, float phaseRandomness)
+    {
+        bank.setUnison(numCopies, spreadCents, width, phaseRandomness);
+    }
+    
+    /**
+     How the two oscillators of every voice are wired: mixed, or one modulating the other's phase (FM), with the depth in
+     cycles. The detune mix still sets how much of each is heard.
+     */
+    void setOperatorRouting(VoiceBank::Routing routing, float depth)
+    {
+        bank.setOperatorRouting(routing, depth);
+    }
+    
+    /// Every voice plays a band-limited pulse of this width (0-1) instead of the triangle. Can change every block
+    void setPulse(bool on, float width)
+    {
+        bank.setPulse(on, width);
+    }
+    
+    /// How much the note-on velocity sets the level of each note, 0 to 1. At 0 every note plays at full level
+    void setVelocitySensitivity(float sensitivity)
+    {
+        bank.setVelocitySensitivity(sensitivity);
+    }
     
+    /// How many voices can sound at once, up to the number of voices added. Nothing is allocated, so it can change every block
+    void setPolyphony(int newPolyphony)
+    {
+        polyphony = juce::jlimit(1, juce::jmax(1, voices.size()), newPolyphony);
+    }
+    
+protected:
+    /// A voice that isn't sounding, as long as fewer than the polyphony are and the bank has room for its unison. Otherwise
+    /// one is stolen.
+    juce::SynthesiserVoice* findFreeVoice(juce::SynthesiserSound* soundToPlay, int midiChannel, int midiNoteNumber,
+                                          bool stealIfNoneAvailable) const override
+    {
+        if (bank.getNumPlaying() < polyphony && bank.hasRoomForNote())
+        {
+            for (int i = 0; i < voices.size(); i++)
+            {
+                auto* voice = voices.getUnchecked(i);
+                
+                if (! voice->isVoiceActive() && voice->canPlaySound(soundToPlay))
+                    return voice;
+            }
+        }
+        
+        return stealIfNoneAvailable ? findVoiceToSteal(soundToPlay, midiChannel, midiNoteNumber) : nullptr;
+    }
+    
+    /// Steal a released voice before a held one, and the newest notes last (see VoiceBank::findVoiceToSteal()): one that
+    /// is nearly done releasing is missed far less than one at full level, or one that has only just started
+    juce::SynthesiserVoice* findVoiceToSteal(juce::SynthesiserSound*, int /*midiChannel*/, int /*midiNoteNumber*/) const override
+    {
+        const int index = bank.findVoiceToSteal();
+        return index >= 0 ? voices.getUnchecked(index) : nullptr;
+    }
+    
+    void renderVoices(juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples) override
+    {
+        bank.render(outputAudio, startSample, numSamples);
+    
+        //Tell the synthesiser about the voices that finished during this block. Only those are visited, not every voice
+        for (int index : bank.getFinishedVoices())
+        {
+            auto* voice = static_cast<MySynthVoice*>(voices.getUnchecked(index));
+            jassert(voice->getVoiceIndex() == index);
+    
+            voice->noteFinished();
+        }
+    }
 
+private:
+    VoiceBank bank;
+    
+    //Until it is set, every voice can sound
+    int polyphony = std::numeric_limits<int>::max();
 };
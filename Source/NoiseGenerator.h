@@ -9,94 +9,463 @@
 
 #pragma once
 
+#include <JuceHeader.h>
+#include <cmath>
+#include <cstdint>
+#include "DspArena.h"
+#include "ParamSmoother.h"
 
 
 /**
- Having the noise samples as arrays are very handy since at the end, we work with two different buffers than the original output bufffer.
- We do vector calculations (.add, .multiply etc.) with buffers so we can add an array of noise to them.
+ Every plugin instance owns one of these and fills caller-provided spans with noise, so it can run on the audio thread.
+ It never allocates, never locks and never touches the shared juce::Random.
  
- This class produces two types of  noise: white and simple. The WhiteNoiseGenerator uses Muler Generation Methods. For more details refer to https://en.wikipedia.org/wiki/Box%E2%80%93Muller_transform
+ The random numbers come from xoshiro128** (Blackman & Vigna), a small, fast generator with four words of state per instance.
+ The white noise is Gaussian and made with the ziggurat method (Marsaglia & Tsang, "The Ziggurat Method for Generating Random
+ Variables", 2000). About 98% of the samples cost one random number, one table lookup, one compare and one multiply. Only the
+ rare samples in the tail or on the edge of a layer need a log or an exp. This replaces the Box-Muller method, which needed
+ logf, sqrtf, sinf and cosf for every pair of samples. For more details refer to https://en.wikipedia.org/wiki/Ziggurat_algorithm
  
+ For renders that must come out the same every time there is also a counter-based stream (Philox4x32-10, Salmon et al.,
+ "Parallel Random Numbers: As Easy as 1, 2, 3", 2011). Each sample is a pure function of the seed, the channel and the
+ absolute sample position, and there is no state to carry. Any block can be regenerated on its own or in parallel, channels
+ are decorrelated by giving them different channel numbers, and the result does not depend on the block size.
+
+ The white noise can be coloured in place: pink with Paul Kellet's refined filter (-3dB/octave), or brown with a leaky
+ integrator (-6dB/octave). Both are scaled to roughly the level of the white noise. Velvet noise is sparse: one impulse of
+ +1 or -1 at a random spot in every grid period (Valimaki et al., "Noise analysis of velvet noise", 2013). Its positions come
+ from the counter-based stream per grid period, so its cost follows the impulse density and not the sample count.
+
+ The time spent filling is measured, and getSamplesPerSecond() gives the throughput.
 */
 
 class NoiseGenerators
 {
 public:
-    //A static array funtion of simpleNoise
-    static juce::Array<float> getSimpleNoise(int numSamples)
+    /// The order matches the "noiseColour" parameter choices
+    enum class Colour
     {
-        //Add a random number to the array
-        juce::Random r = juce::Random::getSystemRandom();
-        juce::Array<float> randomSample;
+        white = 0,
+        pink,
+        brown,
+        velvet
+    };
 
-        for (int s = 0; s < numSamples; s++)
+    NoiseGenerators()
+    {
+        //Seeding on the message thread is fine, it's only the audio thread that must not touch the shared juce::Random
+        setSeed((uint64_t) juce::Random::getSystemRandom().nextInt64());
+        randomKey = (uint32_t) juce::Random::getSystemRandom().nextInt64();
+
+        //Build the ziggurat tables now rather than on the first audio block
+        getTables();
+    }
+
+    /// Takes the filter state of every channel from the arena: call from prepareToPlay
+    void prepare(double newSampleRate, int numChannels, DspArena& arena)
+    {
+        sampleRate = newSampleRate;
+        numFilters = juce::jmax(numChannels, 1);
+        filters = arena.construct<FilterState>((size_t) numFilters);
+    }
+
+    /// Restart the random sequence from a known seed
+    void setSeed(uint64_t seed)
+    {
+        //Spread the seed over the four words with splitmix64, as the xoshiro authors recommend
+        for (int i = 0; i < 4; i += 2)
         {
-            //Scale the random numbers
-            randomSample.add((r.nextFloat() - 0.5f) * 2.0f);
+            seed += 0x9e3779b97f4a7c15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            z = z ^ (z >> 31);
+
+            state[i] = (uint32_t) z;
+            state[i + 1] = (uint32_t) (z >> 32);
         }
+    }
 
-        //Return the array
-        return randomSample;
+    /// Uniform noise in the range -1 to 1
+    void fillSimpleNoise(float* dest, int numSamples)
+    {
+        const auto startTicks = juce::Time::getHighResolutionTicks();
 
+        for (int s = 0; s < numSamples; s++)
+            dest[s] = (float) (int32_t) next() * (1.0f / 2147483648.0f);
+
+        addToThroughput(numSamples, startTicks);
     }
     
-    //A static array function of WhiteNoise
-    static juce::Array<float> getWhiteNoise(int numSamples)
+    /// Gaussian white noise with a mean of 0 and a standard deviation of 1
+    void fillWhiteNoise(float* dest, int numSamples)
     {
-        juce::Array<float> randomSample;
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        const Tables& t = getTables();
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            //Disjoint bits for the layer and the value, so the two are independent
+            const uint32_t u = next();
+            const uint32_t layer = u & 127u;
+            const int32_t hz = (int32_t) (u & ~127u);
 
-        //Variables fot the Muller Generation Method
-        float z0 = 0;
-        float z1 = 0;
-        bool generate = false;
+            //The common case: the point is inside the layer's rectangle
+            if (magnitude(hz) < t.k[layer])
+                dest[s] = (float) hz * t.w[layer];
+            else
+                dest[s] = sampleEdge(hz, layer, t);
 
-        float mu = 0; // center (0)
-        float sigma = 1; // spread -1 <-> 1
+            // NAN check ...
+            jassert(dest[s] == dest[s]);
+        }
 
-        float output = 0;
-        float u1 = 0;
-        float u2 = 0;
+        addToThroughput(numSamples, startTicks);
+    }
 
-        juce::Random r = juce::Random::getSystemRandom();
-        r.setSeed(juce::Time::getCurrentTime().getMilliseconds());
-        const float epsilon = std::numeric_limits<float>::min();
+    /**
+     Gaussian white noise from the counter-based stream. The same seed, channel and position always give the same samples.
 
-        for (int s = 0; s < numSamples; s++)
+     @param samplePosition absolute position of dest[0], e.g. the host's timeline position in samples
+     @param channel pass the same channel for every channel to get identical noise, or different ones to decorrelate them
+     */
+    void fillDeterministicNoise(float* dest, int numSamples, juce::int64 samplePosition, int channel)
+    {
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+
+        //Each counter gives four samples, so a position maps to counter (position / 4), lane (position % 4)
+        int s = 0;
+
+        while (s < numSamples)
         {
+            const auto position = (uint64_t) (samplePosition + s);
+            float gaussians[4];
+            counterGaussians(position >> 2, (uint32_t) channel, gaussians);
 
-            // GENERATE
-            // using box muller method
-            generate = !generate;
+            for (int lane = (int) (position & 3); lane < 4 && s < numSamples; lane++, s++)
+                dest[s] = gaussians[lane];
+        }
 
-            if (!generate)
-                output = z1 * sigma + mu;
-            else
+        addToThroughput(numSamples, startTicks);
+    }
+
+    /**
+     Colour a span of white noise in place. The filters keep their state per channel between calls, so the result does not
+     depend on the block size. White and velvet leave the span as it is.
+     */
+    void colourNoise(float* noise, int numSamples, Colour colour, int channel)
+    {
+        if (colour != Colour::pink && colour != Colour::brown)
+            return;
+
+        jassert(channel < numFilters);
+
+        if (channel >= numFilters)
+            return;
+
+        FilterState& f = filters[channel];
+
+        if (colour == Colour::pink)
+        {
+            float b0 = f.pink[0], b1 = f.pink[1], b2 = f.pink[2], b3 = f.pink[3], b4 = f.pink[4], b5 = f.pink[5], b6 = f.pink[6];
+
+            for (int s = 0; s < numSamples; s++)
+            {
+                const float white = noise[s];
+                b0 = 0.99886f * b0 + white * 0.0555179f;
+                b1 = 0.99332f * b1 + white * 0.0750759f;
+                b2 = 0.96900f * b2 + white * 0.1538520f;
+                b3 = 0.86650f * b3 + white * 0.3104856f;
+                b4 = 0.55000f * b4 + white * 0.5329522f;
+                b5 = -0.7616f * b5 - white * 0.0168980f;
+                noise[s] = (b0 + b1 + b2 + b3 + b4 + b5 + b6 + white * 0.5362f) * pinkGain;
+                b6 = white * 0.115926f;
+            }
+
+            f.pink[0] = b0; f.pink[1] = b1; f.pink[2] = b2; f.pink[3] = b3; f.pink[4] = b4; f.pink[5] = b5; f.pink[6] = b6;
+        }
+        else
+        {
+            float y = f.brown;
+
+            for (int s = 0; s < numSamples; s++)
+            {
+                y = (y + 0.02f * noise[s]) * (1.0f / 1.02f);
+                noise[s] = y * brownGain;
+            }
+
+            f.brown = y;
+        }
+    }
+
+    /// Set the number of velvet noise impulses per second
+    void setVelvetDensity(float impulsesPerSecond)
+    {
+        velvetPeriod = juce::jmax(1.0, sampleRate / juce::jmax(1.0f, impulsesPerSecond));
+    }
+
+    /// Velvet noise into a span: zeros, with one impulse of +1 or -1 per grid period
+    void fillVelvetNoise(float* dest, int numSamples, juce::int64 samplePosition, int channel, bool deterministic)
+    {
+        juce::FloatVectorOperations::clear(dest, numSamples);
+
+        forEachVelvetImpulse(numSamples, samplePosition, channel, deterministic, [dest] (int index, float sign)
+        {
+            dest[index] = sign;
+        });
+    }
+
+    /**
+     Apply velvet noise to a signal in place, the same way the crusher applies dense noise: data + (noise * gain) * data.
+     Only the impulse positions are touched, so this costs one multiply-add per impulse and nothing for the samples between.
+     A gain ramp is read at the impulses only.
+     */
+    void applyVelvetNoise(float* data, int numSamples, const SmoothedSpan& gain, juce::int64 samplePosition, int channel,
+                          bool deterministic)
+    {
+        forEachVelvetImpulse(numSamples, samplePosition, channel, deterministic, [data, &gain] (int index, float sign)
+        {
+            data[index] += (sign * gain.at(index)) * data[index];
+        });
+    }
+
+    /// The key of the counter-based stream
+    void setDeterministicSeed(uint32_t seed)
+    {
+        key[0] = seed;
+        key[1] = 0x5ca1ab1eu;
+    }
+
+    /// Samples generated per second of time spent generating them, since the last reset
+    double getSamplesPerSecond() const
+    {
+        const auto ticks = totalTicks.load();
+
+        if (ticks <= 0)
+            return 0.0;
+
+        return (double) totalSamples.load() / juce::Time::highResolutionTicksToSeconds(ticks);
+    }
+
+    void resetThroughput()
+    {
+        totalSamples = 0;
+        totalTicks = 0;
+    }
+
+private:
+    struct Tables
+    {
+        Tables()
+        {
+            //Ziggurat tables for the normal distribution with 128 layers, from Marsaglia & Tsang
+            const double m1 = 2147483648.0;
+            const double vn = 9.91256303526217e-3;
+            double dn = tailStart;
+            double tn = dn;
+
+            const double q = vn / std::exp(-0.5 * dn * dn);
+            k[0] = (uint32_t) ((dn / q) * m1);
+            k[1] = 0;
+            w[0] = (float) (q / m1);
+            w[127] = (float) (dn / m1);
+            f[0] = 1.0f;
+            f[127] = (float) std::exp(-0.5 * dn * dn);
+
+            for (int i = 126; i >= 1; i--)
+            {
+                dn = std::sqrt(-2.0 * std::log(vn / dn + std::exp(-0.5 * dn * dn)));
+                k[i + 1] = (uint32_t) ((dn / tn) * m1);
+                tn = dn;
+                f[i] = (float) std::exp(-0.5 * dn * dn);
+                w[i] = (float) (dn / m1);
+            }
+        }
+
+        static constexpr double tailStart = 3.442619855899;
+
+        uint32_t k[128];
+        float w[128];
+        float f[128];
+    };
+
+    static const Tables& getTables()
+    {
+        static const Tables tables;
+        return tables;
+    }
+
+    /// xoshiro128**
+    inline uint32_t next()
+    {
+        const uint32_t result = rotl(state[1] * 5, 7) * 9;
+        const uint32_t t = state[1] << 9;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 11);
+
+        return result;
+    }
+
+    static inline uint32_t rotl(uint32_t x, int k)
+    {
+        return (x << k) | (x >> (32 - k));
+    }
+
+    static inline uint32_t magnitude(int32_t x)
+    {
+        return x < 0 ? 0u - (uint32_t) x : (uint32_t) x;
+    }
+
+    /// Uniform in (0, 1), never 0 so it is safe to take the log of
+    inline float nextUniform()
+    {
+        return (float) (next() >> 8) * (1.0f / 16777216.0f) + (0.5f / 16777216.0f);
+    }
+
+    /// The slow path, for points outside the layer's rectangle
+    float sampleEdge(int32_t hz, uint32_t layer, const Tables& t)
+    {
+        const float r = (float) Tables::tailStart;
+
+        for (;;)
+        {
+            const float x = (float) hz * t.w[layer];
+
+            //The base layer: sample from the tail beyond r
+            if (layer == 0)
             {
+                float tx, ty;
+
                 do
                 {
-                    u1 = r.nextFloat();
-                    u2 = r.nextFloat();
-                } while (u1 <= epsilon);
+                    tx = -std::log(nextUniform()) / r;
+                    ty = -std::log(nextUniform());
+                } while (ty + ty < tx * tx);
 
-                z0 = sqrtf(-2.f * logf(u1)) * cosf(2.f * juce::float_Pi * u2);
-                z1 = sqrtf(-2.f * logf(u1)) * sinf(2.f * juce::float_Pi * u2);
-
-                output = z0 * sigma + mu;
+                return hz > 0 ? r + tx : -r - tx;
             }
 
-            // NAN check ...
-            jassert(output == output);
-            jassert(output > -50 && output < 50);
+            //The wedge between this layer's rectangle and the curve
+            if (t.f[layer] + nextUniform() * (t.f[layer - 1] - t.f[layer]) < std::exp(-0.5f * x * x))
+                return x;
 
-            //
-            randomSample.add(output);
+            //Rejected, so try again with a new point
+            const uint32_t u = next();
+            layer = u & 127u;
+            hz = (int32_t) (u & ~127u);
 
+            if (magnitude(hz) < t.k[layer])
+                return (float) hz * t.w[layer];
         }
-        return randomSample;
     }
 
+    /// Philox4x32-10: ten rounds of multiply and xor over a 128-bit counter, keyed by 64 bits
+    static void philox(uint32_t counter[4], uint32_t k0, uint32_t k1)
+    {
+        for (int round = 0; round < 10; round++)
+        {
+            const uint64_t product0 = (uint64_t) 0xD2511F53u * counter[0];
+            const uint64_t product1 = (uint64_t) 0xCD9E8D57u * counter[2];
+
+            const uint32_t c0 = (uint32_t) (product1 >> 32) ^ counter[1] ^ k0;
+            const uint32_t c1 = (uint32_t) product1;
+            const uint32_t c2 = (uint32_t) (product0 >> 32) ^ counter[3] ^ k1;
+            const uint32_t c3 = (uint32_t) product0;
+
+            counter[0] = c0;
+            counter[1] = c1;
+            counter[2] = c2;
+            counter[3] = c3;
+
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+    }
+
+    /// Four Gaussian samples for one counter, from two Box-Muller pairs
+    void counterGaussians(uint64_t counterIndex, uint32_t channel, float* out) const
+    {
+        uint32_t counter[4] = { (uint32_t) counterIndex, (uint32_t) (counterIndex >> 32), channel, 0 };
+        philox(counter, key[0], key[1]);
+
+        for (int pair = 0; pair < 2; pair++)
+        {
+            //u1 is in (0, 1) so the log is safe
+            const float u1 = (float) (counter[pair * 2] >> 8) * (1.0f / 16777216.0f) + (0.5f / 16777216.0f);
+            const float u2 = (float) (counter[pair * 2 + 1] >> 8) * (1.0f / 16777216.0f);
+
+            const float radius = std::sqrt(-2.0f * std::log(u1));
+            const float angle = 2.0f * juce::MathConstants<float>::pi * u2;
+
+            out[pair * 2] = radius * std::cos(angle);
+            out[pair * 2 + 1] = radius * std::sin(angle);
+        }
+    }
+
+    /**
+     Calls impulse (index, sign) for the velvet impulses that land in [samplePosition, samplePosition + numSamples). Grid period
+     m covers [floor (m * T), floor ((m + 1) * T)). Its impulse position and sign come from the counter-based stream, keyed by m.
+     */
+    template <typename Callback>
+    void forEachVelvetImpulse(int numSamples, juce::int64 samplePosition, int channel, bool deterministic, Callback&& impulse)
+    {
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        const uint32_t k0 = deterministic ? key[0] : randomKey;
+        const double period = velvetPeriod;
+        const juce::int64 end = samplePosition + numSamples;
+
+        for (auto cell = (juce::int64) std::floor((double) samplePosition / period); ; cell++)
+        {
+            const auto cellStart = (juce::int64) std::floor((double) cell * period);
+
+            if (cellStart >= end)
+                break;
+
+            const auto cellLength = (juce::int64) std::floor((double) (cell + 1) * period) - cellStart;
+
+            //Stream 1 of the counter space, so the positions don't repeat the white noise values
+            uint32_t counter[4] = { (uint32_t) cell, (uint32_t) ((uint64_t) cell >> 32), (uint32_t) channel, 1 };
+            philox(counter, k0, key[1]);
+
+            const juce::int64 position = cellStart + (juce::int64) (((uint64_t) counter[0] * (uint64_t) cellLength) >> 32);
+
+            if (position >= samplePosition && position < end)
+                impulse((int) (position - samplePosition), (counter[2] & 0x80000000u) != 0 ? 1.0f : -1.0f);
+        }
+
+        addToThroughput(numSamples, startTicks);
+    }
+
+    void addToThroughput(int numSamples, juce::int64 startTicks)
+    {
+        totalTicks += juce::Time::getHighResolutionTicks() - startTicks;
+        totalSamples += numSamples;
+    }
     
-private:
+    uint32_t state[4] = { 1, 2, 3, 4 };
+    uint32_t key[2] = { 0, 0x5ca1ab1eu };
+    uint32_t randomKey = 0;
+
+    //Kellet's pink filter is about 3 times louder than its input and the brown integrator about 10 times quieter
+    static constexpr float pinkGain = 0.33f;
+    static constexpr float brownGain = 10.0f;
+
+    struct FilterState
+    {
+        float pink[7] = { 0, 0, 0, 0, 0, 0, 0 };
+        float brown = 0.0f;
+    };
+
+    FilterState* filters = nullptr;
+    int numFilters = 0;
+    double sampleRate = 44100.0;
+    double velvetPeriod = 22.05;
     
+    std::atomic<juce::int64> totalSamples { 0 };
+    std::atomic<juce::int64> totalTicks { 0 };
 };
-
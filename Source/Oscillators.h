@@ -9,18 +9,26 @@
 #ifndef Oscillators_h
 #define Oscillators_h
 
+#include <cmath>
+#include "SineKernels.h"
+#include "FixedPointPhase.h"
+
 /**
  Base oscillator class
  
  outputs the phase directly in the range: 0-1
+
+ The waveform classes pass themselves in as the template argument (CRTP), so output() is resolved at compile time rather
+ than through a virtual call on every sample. That lets the compiler inline the waveform and vectorize processBlock().
+
+ The phase is a float, or an integer when ALPACON_PHASE_BITS is set (see "FixedPointPhase.h"). The float API is the same
+ either way.
  */
-class Phasor
+template <typename Derived>
+class PhasorBase
 {
 public:
     
-    /// empty destructor function
-    virtual ~Phasor() {};
-    
     // Our parent oscillator class does the key things required for most oscillators:
     // -- handles phase
     // -- handles setters and getters for frequency and samplerate
@@ -28,18 +36,53 @@ public:
     /// update the phase and output the next sample from the oscillator
     float process()
     {
-        phase += phaseDelta;
-        
-        if (phase > 1.0f)
-            phase -= 1.0f;
+        advance();
         
-        return output(phase);
+        if (phaseOffset != 0.0f)
+            return derived().output(wrapPhase(getPhase() + phaseOffset));
+
+        return derived().output(getPhase());
     }
     
-    /// this function is the one that we will replace in the classes that inherit from Phasor
-    virtual float output(float p)
+    /**
+     render a block of samples. Gives exactly the same samples as calling process() numSamples times
+
+     @param out where to write the samples
+     @param numSamples how many samples to render
+     */
+    void processBlock(float* out, int numSamples)
     {
-        return p;
+        // first the phases: a short running sum, the only part that has to go one sample at a time
+        renderPhases(out, numSamples);
+
+        // then the waveform: no dependency between samples, so this loop can be vectorized
+        Derived& d = derived();
+
+        if (phaseOffset != 0.0f)
+            for (int i = 0; i < numSamples; i++)
+                out[i] = wrapPhase(out[i] + phaseOffset);
+
+        for (int i = 0; i < numSamples; i++)
+            out[i] = d.output(out[i]);
+    }
+
+    /**
+     render a block of samples with phase modulation: every sample's phase is moved by the same sample of another signal,
+     e.g. another oscillator's processBlock() output. That is FM as the DX7 does it. The phase offset is added as well.
+
+     @param out where to write the samples. Can't be the same memory as phaseMod
+     @param phaseMod how far to move each sample's phase, in cycles (before the depth)
+     @param numSamples how many samples to render
+     @param depth scales the whole of phaseMod
+     */
+    void processBlock(float* out, const float* phaseMod, int numSamples, float depth = 1.0f)
+    {
+        renderModulatedPhases(out, phaseMod, numSamples, depth);
+
+        Derived& d = derived();
+
+        for (int i = 0; i < numSamples; i++)
+            out[i] = d.output(out[i]);
     }
     
     /**
@@ -61,34 +104,125 @@ public:
     {
         frequency = freq;
         phaseDelta = frequency / sampleRate;
+
+       #if ALPACON_PHASE_BITS
+        //worked out in double, so the only rounding is to the last bit of the increment
+        fixedPhaseDelta = FixedPointPhase::fromCycles((double) frequency / (double) sampleRate);
+       #endif
     }
 
     
     
-    /// for phase modulation:
+    /// for phase modulation: a fixed offset, in cycles, added to the phase of every sample after this
     void setPhaseOffset(float _phaseOffset)
     {
         phaseOffset = _phaseOffset;
     }
     
+    float getPhaseOffset() const
+    {
+        return phaseOffset;
+    }
+
+    /// any phase above -64 brought back into 0-1. Going through int rather than floor() lets a loop of these vectorize
+    static inline float wrapPhase(float p)
+    {
+        return p - (float) ((int) (p + 64.0f) - 64);
+    }
+
+protected:
+    /// move the phase on by one sample, wrapping it back into 0-1
+    inline void advance()
+    {
+       #if ALPACON_PHASE_BITS
+        //wraps by overflowing
+        fixedPhase += fixedPhaseDelta;
+       #else
+        phase += phaseDelta;
+
+        if (phase > 1.0f)
+            phase -= 1.0f;
+       #endif
+    }
+
+    /// write the phase of each of the next numSamples samples
+    void renderPhases(float* out, int numSamples)
+    {
+        for (int i = 0; i < numSamples; i++)
+        {
+            advance();
+            out[i] = getPhase();
+        }
+    }
+
+    /// the same with the offset and phase modulation added, and wrapped into 0-1
+    void renderModulatedPhases(float* out, const float* phaseMod, int numSamples, float depth)
+    {
+        renderPhases(out, numSamples);
+
+        for (int i = 0; i < numSamples; i++)
+            out[i] = wrapPhase(out[i] + phaseOffset + depth * phaseMod[i]);
+    }
+
+    /// move the phase on by numSamples in one go, for waveforms that don't need the phase of every sample
+    void skip(int numSamples)
+    {
+       #if ALPACON_PHASE_BITS
+        fixedPhase += (FixedPointPhase::Phase) numSamples * fixedPhaseDelta;
+       #else
+        phase += (float) numSamples * phaseDelta;
+        phase -= std::floor(phase);
+       #endif
+    }
+
+   #if ALPACON_PHASE_BITS
+    float getPhase() const          { return FixedPointPhase::toCycles(fixedPhase); }
+
+    FixedPointPhase::Phase getFixedPhase() const        { return fixedPhase; }
+   #else
+    float getPhase() const          { return phase; }
+   #endif
+
+    float getPhaseDelta() const     { return phaseDelta; }
+
 private:
+    Derived& derived()      { return static_cast<Derived&> (*this); }
+
     float frequency;
     float sampleRate;
     float phase = 0.0f;
-    float phaseDelta;
+    float phaseDelta = 0.0f;
     
+   #if ALPACON_PHASE_BITS
+    FixedPointPhase::Phase fixedPhase = 0;
+    FixedPointPhase::Phase fixedPhaseDelta = 0;
+   #endif
+
     float phaseOffset = 0.0;        // for phase modulation
 };
 
+/**
+ The plain phasor: outputs the phase
+ */
+class Phasor : public PhasorBase<Phasor>
+{
+public:
+    float output(float p) const
+    {
+        return p;
+    }
+};
+
 /**
  Triangle oscillator built on Phasor base class
  
  Note that the output is quiet by default: ±0.25
  */
-class TriOsc : public Phasor
+class TriOsc : public PhasorBase<TriOsc>
 {
-    // redefine (override) the output function so that we can return a different function of the phase (p)
-    float output(float p) override
+public:
+    // define the output function so that we can return a different function of the phase (p)
+    float output(float p) const
     {
         return fabsf(p - 0.5f) - 0.5f;
     }
@@ -98,24 +232,116 @@ class TriOsc : public Phasor
 
 /**
  Sine Oscillator built on Phasor base class
+
+ The sine itself comes from one of the kernels in "SineKernels.h", chosen with setEngine(). See there for the cost and
+ accuracy of each.
  */
-class SinOsc : public Phasor
+class SinOsc : public PhasorBase<SinOsc>
 {
-    float output(float p) override
+public:
+    using PhasorBase::processBlock;
+
+    /// choose how the sine is worked out. Can be changed at any time, the phase carries on
+    void setEngine(SineEngine newEngine)
     {
-        return std::sin(p * 2.0 * 3.14159);
+        engine = newEngine;
+
+        if (engine == SineEngine::table)
+            SineKernels::prepareTable();
     }
+
+    SineEngine getEngine() const
+    {
+        return engine;
+    }
+
+    float output(float p) const
+    {
+        switch (engine)
+        {
+            case SineEngine::standard:  return SineKernels::standard(p);
+            case SineEngine::table:     return SineKernels::table(p);
+
+            // one sample at a time there is nothing to gain from the rotation, so the quadrature engine uses the polynomial
+            case SineEngine::polynomial:
+            case SineEngine::quadrature:
+            default:                    return SineKernels::polynomial(p);
+        }
+    }
+
+    /// render a block of samples. Picks the kernel once for the whole block rather than once per sample
+    void processBlock(float* out, int numSamples)
+    {
+        if (getPhaseOffset() != 0.0f)
+        {
+            //the rotation and the integer table index both need the plain phase, so an offset goes through the kernels
+            renderModulatedPhases(out, out, numSamples, 0.0f);
+            renderKernel(out, numSamples);
+            return;
+        }
+
+        if (engine == SineEngine::quadrature)
+        {
+            SineKernels::quadrature(out, numSamples, getPhase(), getPhaseDelta());
+            skip(numSamples);
+            return;
+        }
+
+       #if ALPACON_PHASE_BITS
+        //with an integer phase the table index is a shift, so skip the float phases
+        if (engine == SineEngine::table)
+        {
+            for (int i = 0; i < numSamples; i++)
+            {
+                advance();
+                out[i] = SineKernels::table(FixedPointPhase::top32(getFixedPhase()));
+            }
+
+            return;
+        }
+       #endif
+
+        renderPhases(out, numSamples);
+        renderKernel(out, numSamples);
+    }
+
+    /// phase modulated, as PhasorBase::processBlock(). The quadrature engine can't follow a moving phase, so it uses the
+    /// polynomial here
+    void processBlock(float* out, const float* phaseMod, int numSamples, float depth = 1.0f)
+    {
+        renderModulatedPhases(out, phaseMod, numSamples, depth);
+        renderKernel(out, numSamples);
+    }
+
+private:
+    /// the chosen kernel over a span of phases
+    void renderKernel(float* data, int numSamples) const
+    {
+        switch (engine)
+        {
+            case SineEngine::standard:  SineKernels::standard(data, numSamples); break;
+            case SineEngine::table:     SineKernels::table(data, numSamples); break;
+            case SineEngine::polynomial:
+            case SineEngine::quadrature:
+            default:                    SineKernels::polynomial(data, numSamples); break;
+        }
+    }
+
+    SineEngine engine = SineEngine::polynomial;
 };
 
 /**
  Squarewave Oscillator built on Phasor base class
  
  Includes setPulseWidth to change the waveform shape
+
+ Works out the ideal waveform, so it aliases. The voices' pulse (see VoiceBank::setPulse()) is the band-limited version,
+ read from the saw wavetable, with the same pulse width control
  */
-class SquareOsc : public Phasor
+class SquareOsc : public PhasorBase<SquareOsc>
 {
 public:
-    float output(float p) override
+    float output(float p) const
     {
         float outVal = 0.5;
         if (p > pulseWidth)
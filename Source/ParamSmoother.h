@@ -0,0 +1,131 @@
+/*
+  ==============================================================================
+
+    ParamSmoother.h
+    Created: 17 Oct 2026 9:12:40pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include "DspArena.h"
+
+/**
+ A parameter's values over one block, as a ParamSmoother gives them: one value per sample while the parameter is moving,
+ or just the value while it is steady.
+
+ A kernel checks which once per call and has a loop for each, so nothing is tested per sample, and a steady parameter
+ costs what a plain float did.
+ */
+struct SmoothedSpan
+{
+    /// One value per sample from the start of the block, or nullptr while the parameter is steady
+    const float* ramp = nullptr;
+
+    /// The value while steady. While ramping, the value at the end of the block
+    float value = 0.0f;
+
+    bool isRamping() const                  { return ramp != nullptr; }
+
+    /// The value at one sample. Has a branch, so only for code that runs once per many samples (e.g. per impulse)
+    float at(int sample) const              { return ramp != nullptr ? ramp[sample] : value; }
+
+    /// The same values from a later sample on, for code that works on part of the block
+    SmoothedSpan from(int sample) const     { return { ramp != nullptr ? ramp + sample : nullptr, value }; }
+};
+
+/**
+ Smooths a parameter that is read once per block into a linear ramp, so automation has no zipper noise whatever the block
+ size.
+
+ Set the target every block from the parameter, then process() gives the block's values. Only while the value is moving
+ is a ramp written. Each sample of it is worked out from where the ramp started rather than added on to the one before, so
+ the fill vectorizes and the values are the same whatever the block size. Once the ramp gets to the target it lands on it
+ exactly and the span is steady again.
+ */
+class ParamSmoother
+{
+public:
+    /**
+     Take the ramp from the arena. Call from prepareToPlay, not on the audio thread. The value jumps to the target.
+
+     @param rampSeconds how long a change takes to get to its new value
+     */
+    void prepare(double sampleRate, int maxBlockSize, DspArena& arena, double rampSeconds = 0.02)
+    {
+        rampLength = juce::jmax(1, (int) std::round(rampSeconds * sampleRate));
+        rampSize = juce::jmax(1, maxBlockSize);
+        ramp = arena.allocate<float>((size_t) rampSize);
+        setCurrentAndTargetValue(target);
+    }
+
+    /// Go straight to a value, with no ramp (e.g. before playback starts)
+    void setCurrentAndTargetValue(float newValue)
+    {
+        current = target = newValue;
+        remaining = 0;
+    }
+
+    /// Once per block, from the parameter. A new target starts a new ramp from wherever the value is now
+    void setTargetValue(float newTarget)
+    {
+        if (newTarget == target)
+            return;
+
+        target = newTarget;
+        rampStart = current;
+        increment = (target - current) / (float) rampLength;
+        remaining = rampLength;
+    }
+
+    bool isSmoothing() const        { return remaining > 0; }
+    float getTargetValue() const    { return target; }
+
+    /**
+     The values for the next numSamples samples. The span's ramp is valid until the next call.
+
+     A block longer than the one prepared for has nowhere to put its ramp, so the value jumps to the target.
+     */
+    SmoothedSpan process(int numSamples)
+    {
+        if (remaining == 0)
+            return { nullptr, current };
+
+        if (numSamples > rampSize)
+        {
+            setCurrentAndTargetValue(target);
+            return { nullptr, current };
+        }
+
+        const int rampSamples = juce::jmin(numSamples, remaining);
+        const int done = rampLength - remaining;
+        float* values = ramp;
+
+        for (int i = 0; i < rampSamples; i++)
+            values[i] = rampStart + increment * (float) (done + i + 1);
+
+        remaining -= rampSamples;
+
+        if (remaining == 0)
+        {
+            //The last step lands exactly on the target, and the rest of the block stays there
+            std::fill(values + rampSamples - 1, values + numSamples, target);
+            current = target;
+        }
+        else
+        {
+            current = values[rampSamples - 1];
+        }
+
+        return { values, current };
+    }
+
+private:
+    float* ramp = nullptr;
+    int rampSize = 0;
+    float current = 0.0f, target = 0.0f, rampStart = 0.0f, increment = 0.0f;
+    int rampLength = 1, remaining = 0;
+};
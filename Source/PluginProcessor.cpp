@@ -24,14 +24,18 @@
  My thanks to all these people and sources as well as our instructors for the "Oscillators.h , DelayLine.h files and base of  MySynth.h file.
  */
 
+//The parameter constructors take their ranges by reference, and in C++14 that needs the constants defined somewhere
+constexpr int MidiTryAudioProcessor::maxVoices;
+constexpr int VoiceBank::maxUnison;
+constexpr int MultiTapDelay::maxTaps;
+
 //==============================================================================
 MidiTryAudioProcessor::MidiTryAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
      : AudioProcessor (BusesProperties()
                      #if ! JucePlugin_IsMidiEffect
-                      #if ! JucePlugin_IsSynth
-                       .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
-                      #endif
+                      //The input is crushed in place. A synth build has one too, off until the host turns it on
+                       .withInput  ("Input",  juce::AudioChannelSet::stereo(), ! JucePlugin_IsSynth)
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
                        ),
@@ -45,7 +49,8 @@ parameters(*this,nullptr,"ParamTreeID",{
     std::make_unique<juce::AudioParameterFloat>("noise","Noise",juce::NormalisableRange<float>(0.0f, 100.0f, 1.0f),2.0f),
     
     //Sample Rate and Bit Depth
-    std::make_unique<juce::AudioParameterFloat>("rate", "Rate", juce::NormalisableRange<float>(0.0f, 50.0f, 1.0f), 0.0f),
+    //The rate can be fractional, the sample and hold carries the remainder over
+    std::make_unique<juce::AudioParameterFloat>("rate", "Rate", juce::NormalisableRange<float>(0.0f, 50.0f, 0.01f), 0.0f),
     std::make_unique<juce::AudioParameterFloat>("bits", "Bits", juce::NormalisableRange<float>(1.0f, 32.0f, 1.0f), 24.0f),
     
     //To switch the detune on and off
@@ -57,6 +62,73 @@ parameters(*this,nullptr,"ParamTreeID",{
     //The speed of LFO that controls the detuning
     std::make_unique<juce::AudioParameterFloat>("lfoSpeed","LFO Rate",0.0f, 400.0f ,10.0f),
     
+    //Work the LFO out at every sample rather than every few samples. Costs more, for the fastest rates
+    std::make_unique<juce::AudioParameterBool>("lfoAudioRate","LFO At Audio Rate",false),
+    
+    //Noise that comes out the same on every render: the seed, and whether each channel gets its own noise. Off by default,
+    //so every instance has noise of its own from the fast engine, and two tracks' noise doesn't add up coherently
+    std::make_unique<juce::AudioParameterBool>("noiseDeterministic","Deterministic Noise",false),
+    std::make_unique<juce::AudioParameterInt>("noiseSeed","Noise Seed",0,9999,0),
+    std::make_unique<juce::AudioParameterBool>("noiseStereo","Stereo Noise",false),
+    
+    //The colour of the noise, and how many impulses per second the sparse velvet noise has
+    std::make_unique<juce::AudioParameterChoice>("noiseColour","Noise Colour",juce::StringArray { "White", "Pink", "Brown", "Velvet" },0),
+    std::make_unique<juce::AudioParameterFloat>("velvetDensity","Velvet Density",juce::NormalisableRange<float>(50.0f, 20000.0f, 1.0f, 0.3f),2000.0f),
+    
+    //Extra threads helping to render the voices, for big chords. 0 renders on the audio thread only. The threads are made
+    //when playback is prepared, so turning this on takes effect from the next prepareToPlay
+    std::make_unique<juce::AudioParameterInt>("renderThreads","Render Threads",0,7,0),
+    
+    //How many notes can sound at once. Past that a note is stolen: a released one first, one still in its attack last
+    std::make_unique<juce::AudioParameterInt>("polyphony","Polyphony",1,maxVoices,20),
+    
+    //How much the velocity of a note sets its level. At 0 every note plays at full level
+    std::make_unique<juce::AudioParameterFloat>("velocity","Velocity Sensitivity",0.0f, 1.0f ,0.0f),
+    
+    //The envelope of every note. The times are in seconds, and the shape is how each stage curves
+    std::make_unique<juce::AudioParameterFloat>("attack","Attack",juce::NormalisableRange<float>(0.0f, 5.0f, 0.001f, 0.3f),0.1f),
+    std::make_unique<juce::AudioParameterFloat>("decay","Decay",juce::NormalisableRange<float>(0.0f, 5.0f, 0.001f, 0.3f),0.2f),
+    std::make_unique<juce::AudioParameterFloat>("sustain","Sustain",0.0f, 1.0f ,0.1f),
+    std::make_unique<juce::AudioParameterFloat>("release","Release",juce::NormalisableRange<float>(0.0f, 5.0f, 0.001f, 0.3f),0.1f),
+    std::make_unique<juce::AudioParameterChoice>("envShape","Envelope Shape",juce::StringArray { "Linear", "Exponential" },0),
+    
+    //Unison: copies of every note, tuned apart by the detune in cents, spread across the stereo field by the width, each
+    //starting from a random phase (as much of a cycle as the phase says)
+    std::make_unique<juce::AudioParameterInt>("unison","Unison",1,VoiceBank::maxUnison,1),
+    std::make_unique<juce::AudioParameterFloat>("unisonDetune","Unison Detune",0.0f, 100.0f ,20.0f),
+    std::make_unique<juce::AudioParameterFloat>("unisonWidth","Unison Width",0.0f, 1.0f ,0.5f),
+    std::make_unique<juce::AudioParameterFloat>("unisonPhase","Unison Phase",0.0f, 1.0f ,1.0f),
+    
+    //Phase modulation (FM) between the triangle and the detune sine, and how far the modulator moves the other's phase
+    std::make_unique<juce::AudioParameterChoice>("pmRouting","FM Routing",juce::StringArray { "Off", "Sine > Triangle", "Triangle > Sine" },0),
+    std::make_unique<juce::AudioParameterFloat>("pmDepth","FM Depth",juce::NormalisableRange<float>(0.0f, VoiceBank::maxPMDepth, 0.01f, 0.5f),1.0f),
+    
+    //The voices' main oscillator: the triangle, or a band-limited pulse with this width
+    std::make_unique<juce::AudioParameterChoice>("oscShape","Osc Shape",juce::StringArray { "Triangle", "Pulse" },0),
+    std::make_unique<juce::AudioParameterFloat>("pulseWidth","Pulse Width",0.05f, 0.95f ,0.5f),
+    
+    //The echo after the crusher: its level (0 is off), its time in milliseconds or synced to the host's tempo, and how much
+    //of it feeds back
+    std::make_unique<juce::AudioParameterFloat>("echoMix","Echo Mix",0.0f, 1.0f ,0.0f),
+    std::make_unique<juce::AudioParameterFloat>("echoTime","Echo Time (ms)",juce::NormalisableRange<float>(1.0f, (float) Echo::maxSeconds * 1000.0f, 1.0f, 0.4f),350.0f),
+    std::make_unique<juce::AudioParameterBool>("echoSync","Echo Sync",false),
+    std::make_unique<juce::AudioParameterChoice>("echoDivision","Echo Division",Echo::getDivisionNames(),3),
+    std::make_unique<juce::AudioParameterFloat>("echoFeedback","Echo Feedback",0.0f, 0.95f ,0.4f),
+    
+    //How the echo reads between samples, in the order of DelayInterpolation::Type
+    std::make_unique<juce::AudioParameterChoice>("echoInterpolation","Echo Interpolation",juce::StringArray { "None", "Linear", "Lagrange", "Allpass" },1),
+    
+    //Chorus, flanger or tape wow and flutter on the crushed sound, before the echo: how much of the output it is (0 is
+    //off), how fast and how far its LFO sweeps, and how many taps the chorus and flanger have
+    std::make_unique<juce::AudioParameterChoice>("modMode","Mod Mode",MultiTapDelay::getModeNames(),0),
+    std::make_unique<juce::AudioParameterFloat>("modMix","Mod Mix",0.0f, 1.0f ,0.0f),
+    std::make_unique<juce::AudioParameterFloat>("modRate","Mod Rate",juce::NormalisableRange<float>(0.05f, 10.0f, 0.01f, 0.4f),0.8f),
+    std::make_unique<juce::AudioParameterFloat>("modDepth","Mod Depth",0.0f, 1.0f ,0.5f),
+    std::make_unique<juce::AudioParameterInt>("modTaps","Mod Taps",1,MultiTapDelay::maxTaps,3),
+    
+    //Whether the internal synth plays the MIDI. Off, only the host's input is crushed. On by default in a synth build
+    std::make_unique<juce::AudioParameterBool>("synthOn","Internal Synth",JucePlugin_IsSynth != 0),
+    
 })
 {
     //Assigning each atomic floats with it's respected ValueTree Parameter
@@ -69,14 +141,49 @@ parameters(*this,nullptr,"ParamTreeID",{
     bitsParam = parameters.getRawParameterValue("bits");
     
     rateOfLFO = parameters.getRawParameterValue("lfoSpeed");
+    lfoAudioRate = parameters.getRawParameterValue("lfoAudioRate");
     detuneOn = parameters.getRawParameterValue("detuneOn");
     
     detuneMix = parameters.getRawParameterValue("detuneMix");
     
-    //Here we use the voiceCount to hold that much of sounds at once to process through
-    for ( int voices = 0; voices < voiceCount; voices ++ )
+    noiseDeterministic = parameters.getRawParameterValue("noiseDeterministic");
+    noiseSeed = parameters.getRawParameterValue("noiseSeed");
+    noiseStereo = parameters.getRawParameterValue("noiseStereo");
+    noiseColour = parameters.getRawParameterValue("noiseColour");
+    velvetDensity = parameters.getRawParameterValue("velvetDensity");
+    renderThreads = parameters.getRawParameterValue("renderThreads");
+    polyphony = parameters.getRawParameterValue("polyphony");
+    velocitySensitivity = parameters.getRawParameterValue("velocity");
+    attackParam = parameters.getRawParameterValue("attack");
+    decayParam = parameters.getRawParameterValue("decay");
+    sustainParam = parameters.getRawParameterValue("sustain");
+    releaseParam = parameters.getRawParameterValue("release");
+    envShape = parameters.getRawParameterValue("envShape");
+    unison = parameters.getRawParameterValue("unison");
+    unisonDetune = parameters.getRawParameterValue("unisonDetune");
+    unisonWidth = parameters.getRawParameterValue("unisonWidth");
+    unisonPhase = parameters.getRawParameterValue("unisonPhase");
+    pmRouting = parameters.getRawParameterValue("pmRouting");
+    pmDepth = parameters.getRawParameterValue("pmDepth");
+    oscShape = parameters.getRawParameterValue("oscShape");
+    pulseWidth = parameters.getRawParameterValue("pulseWidth");
+    echoMix = parameters.getRawParameterValue("echoMix");
+    echoTime = parameters.getRawParameterValue("echoTime");
+    echoSync = parameters.getRawParameterValue("echoSync");
+    echoDivision = parameters.getRawParameterValue("echoDivision");
+    echoFeedback = parameters.getRawParameterValue("echoFeedback");
+    echoInterpolation = parameters.getRawParameterValue("echoInterpolation");
+    modMode = parameters.getRawParameterValue("modMode");
+    modMix = parameters.getRawParameterValue("modMix");
+    modRate = parameters.getRawParameterValue("modRate");
+    modDepth = parameters.getRawParameterValue("modDepth");
+    modTaps = parameters.getRawParameterValue("modTaps");
+    synthOn = parameters.getRawParameterValue("synthOn");
+    
+    //All the voices there can ever be are made here. The polyphony parameter limits how many sound at once
+    for ( int voices = 0; voices < maxVoices; voices ++ )
     {
-        synth.addVoice(new MySynthVoice);
+        synth.addVoice(new MySynthVoice(synth.getVoiceBank()));
 
     }
     synth.addSound((new MySynthSound));
@@ -121,7 +228,16 @@ bool MidiTryAudioProcessor::isMidiEffect() const
 
 double MidiTryAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    //What rings on once the input stops: the modulated delay's taps, then the echo's repeats of them
+    double seconds = 0.0;
+    
+    if (*modMix > 0.0f)
+        seconds += MultiTapDelay::maxSeconds;
+    
+    if (*echoMix > 0.0f)
+        seconds += Echo::getTailSeconds(getEchoSeconds(lastBeatsPerMinute.load()), *echoFeedback);
+    
+    return seconds;
 }
 
 int MidiTryAudioProcessor::getNumPrograms()
@@ -151,16 +267,59 @@ void MidiTryAudioProcessor::changeProgramName (int index, const juce::String& ne
 //==============================================================================
 void MidiTryAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    //Setting the sample rate of the synth
-    synth.setCurrentPlaybackSampleRate(sampleRate);
+    //The render threads, never more than there are other cores
+    const int numWorkers = juce::jmin((int) *renderThreads, juce::SystemStats::getNumCpus() - 1);
     
-    //Sending the sampleRate to the "MySyth.h" header as well by dynamic casting
-    for(int i=0; i < voiceCount; i ++)
+    if (numWorkers != renderWorkers.getNumWorkers())
     {
-        MySynthVoice* v= dynamic_cast<MySynthVoice*>(synth.getVoice(i));
-        v -> init(sampleRate);
+        if (numWorkers > 0)
+            renderWorkers.start(numWorkers, 1000.0 * samplesPerBlock / sampleRate);
+        else
+            renderWorkers.stop();
     }
     
+    //The smoothed parameters start where they are, rather than ramping up from nothing
+    bitsSmoother.setCurrentAndTargetValue(*bitsParam);
+    noiseGainSmoother.setCurrentAndTargetValue(getNoiseGain());
+    detuneMixSmoother.setCurrentAndTargetValue(*detuneMix);
+    lfoSpeedSmoother.setCurrentAndTargetValue(*rateOfLFO);
+    echoMixSmoother.setCurrentAndTargetValue(*echoMix);
+    modMixSmoother.setCurrentAndTargetValue(*modMix);
+    
+    //The memory for all the DSP in one go: the modules are prepared once to find out what they take, then again onto the
+    //slab made for it
+    arena.beginLayout();
+    prepareArenaModules(sampleRate, samplesPerBlock);
+    arena.allocateSlab();
+    prepareArenaModules(sampleRate, samplesPerBlock);
+    
+    samplesProcessed = 0;
+}
+
+void MidiTryAudioProcessor::prepareArenaModules (double sampleRate, int samplesPerBlock)
+{
+    //Setting the sample rate of the synth, and sizing the voice bank for the block
+    synth.prepare(sampleRate, samplesPerBlock, arena);
+    
+    for (auto* smoother : { &bitsSmoother, &noiseGainSmoother, &detuneMixSmoother, &lfoSpeedSmoother, &echoMixSmoother, &modMixSmoother })
+        smoother->prepare(sampleRate, samplesPerBlock, arena);
+    
+    //The delays' buffers are as long as their longest times, at this rate
+    modDelay.prepare(sampleRate, getTotalNumOutputChannels(), samplesPerBlock, arena);
+    echo.prepare(sampleRate, getTotalNumOutputChannels(), samplesPerBlock, arena);
+    
+    //One noise channel per output, for when the channels get their own noise
+    const int numNoiseChannels = juce::jmax(1, getTotalNumOutputChannels());
+    float** noiseChannels = arena.allocate<float*>((size_t) numNoiseChannels);
+    
+    for (int chan = 0; chan < numNoiseChannels; chan++)
+        noiseChannels[chan] = arena.allocate<float>((size_t) juce::jmax(1, samplesPerBlock));
+    
+    noiseBuffer.setDataToReferTo(noiseChannels, numNoiseChannels, samplesPerBlock);
+    noiseMaker.prepare(sampleRate, numNoiseChannels, arena);
+    
+    //The crusher works in place on the output channels
+    crusher.prepare(getTotalNumOutputChannels(), arena);
 }
 
 void MidiTryAudioProcessor::releaseResources()
@@ -169,6 +328,11 @@ void MidiTryAudioProcessor::releaseResources()
     // spare memory, etc.
 }
 
+size_t MidiTryAudioProcessor::getMemoryPerVoice() const
+{
+    return synth.getVoiceBank().getMemoryUsage() / maxVoices + sizeof(MySynthVoice);
+}
+
 #ifndef JucePlugin_PreferredChannelConfigurations
 bool MidiTryAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
 {
@@ -184,12 +348,18 @@ bool MidiTryAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
      && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
         return false;
 
-    // This checks if the input layout matches the output layout
-   #if ! JucePlugin_IsSynth
-    if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
-        return false;
+    // This checks if the input layout matches the output layout, as the input is crushed in place.
+    // A synth can also leave its input off
+    const auto input = layouts.getMainInputChannelSet();
+    
+   #if JucePlugin_IsSynth
+    if (input.isDisabled())
+        return true;
    #endif
 
+    if (layouts.getMainOutputChannelSet() != input)
+        return false;
+
     return true;
   #endif
 }
@@ -199,113 +369,163 @@ void MidiTryAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce
 {
     juce::ScopedNoDenormals noDenormals;
     
-    //So that no abrubt sounds or pops
-    buffer.clear();
+    //The host's input, when there is one, is crushed right where it is in the buffer. Only the channels it didn't fill are
+    //cleared, so that no abrubt sounds or pops
+    for (int chan = getTotalNumInputChannels(); chan < buffer.getNumChannels(); chan++)
+        buffer.clear(chan, 0, buffer.getNumSamples());
     
 
-    //Noise parameterss and variables
-    float noiseAmt = -120 + 120 * (*noiseParam / 100); // dB
-    noiseAmt = juce::jlimit<float>(-120, 0, noiseAmt);       // limit (?)
-    noiseAmt = juce::Decibels::decibelsToGain(noiseAmt);     // dB to gain
-    
     //Estabishing the factors and variables for resampling and bit crushing
-    float bitDepth = *bitsParam;
-    auto rateDivide = static_cast<int> (*rateParam);
+    float rateDivide = *rateParam;
     int numSamples = buffer.getNumSamples();
     
-    //MAYBE ADD GAIN VOLUME AS WELL FOR FUTURE USE
-    
-    //This is for security reasons, making sure that if the host changes the buffer sizes without calling prepareToPlay,
-    //it would not crash
-    if (noiseBuffer.getNumSamples() != numSamples)
-    {
-        noiseBuffer.setSize(2, numSamples, false, true, true); // clears
-        currentOutputBuffer.setSize(2, numSamples, false, true, true); // clears
-    }
-    
-    //Copy Of Current Buffer to Populate With Resampled Array
-    currentOutputBuffer.copyFrom(0, 0, buffer.getReadPointer(0), numSamples);
-    
-    //For Stereo
-    if (buffer.getNumChannels() > 1)
-        currentOutputBuffer.copyFrom(1, 0, buffer.getReadPointer(1), numSamples);
-    
-    noiseBuffer.clear();
-    
-    //Building Noise
-    juce::Array<float> noise;
-
-    //Chose to Use White Noise,Could Be Simple Noise As Well
-    noise = noiseMaker.getWhiteNoise(numSamples);
-    
-    // Range Bound fo Noise
-    noiseAmt = juce::jlimit<float>(0, 1, noiseAmt);
+    //The noise level, the bit depth, the detune mix and the LFO speed ramp to a new value rather than stepping, for the
+    //blocks until they get there. Otherwise each is one value for the block, as before
+    noiseGainSmoother.setTargetValue(getNoiseGain());
+    bitsSmoother.setTargetValue(*bitsParam);
+    detuneMixSmoother.setTargetValue(*detuneMix);
+    lfoSpeedSmoother.setTargetValue(*rateOfLFO);
     
+    const SmoothedSpan noiseAmt = noiseGainSmoother.process(numSamples);
+    const SmoothedSpan bitDepth = bitsSmoother.process(numSamples);
+    const bool noiseOn = noiseAmt.isRamping() || noiseAmt.value > 0.0f;
     
+    //MAYBE ADD GAIN VOLUME AS WELL FOR FUTURE USE
     
-    // Controlling the Noise Volume
-    juce::FloatVectorOperations::multiply(noise.getRawDataPointer(), noiseAmt, numSamples);
+    //Where this block sits on the timeline. The deterministic noise is keyed by it, so the same sample of the project always
+    //gets the same noise, whatever the block size. When the transport is stopped keep counting, or the noise would repeat
+    juce::int64 blockPosition = samplesProcessed;
     
-    //Adding The Noise to Noise Buffer In Stereo
-    juce::FloatVectorOperations::add(noiseBuffer.getWritePointer(0), noise.getRawDataPointer(), numSamples);
-    juce::FloatVectorOperations::add(noiseBuffer.getWritePointer(1), noise.getRawDataPointer(), numSamples);
+    //The tempo for the synced echo. 120 when the host doesn't say
+    double beatsPerMinute = 120.0;
     
-    //Dynamic Casting the Variables to Respected Functions in "MySynth.h" Header File
-    for(int i=0; i < voiceCount; i ++)
+    if (auto* playHead = getPlayHead())
     {
-            
-        MySynthVoice* v= dynamic_cast<MySynthVoice*>(synth.getVoice(i));
-        
-        v -> setDetune(*detuneParam);
-        v->setLFOFreq(*rateOfLFO);
-        v -> openDetune(*detuneOn);
-        v-> setDetuneMix(*detuneMix);
-      
-    }
-
-    //Adding Our Midi Samples from our Synth to currentOutputBuffer
-    synth.renderNextBlock(currentOutputBuffer, midiMessages, 0, numSamples);
+        if (auto position = playHead->getPosition())
+        {
+            if (position->getIsPlaying())
+                if (auto timeInSamples = position->getTimeInSamples())
+                    blockPosition = *timeInSamples;
     
-    //Multiply the Noise Buffer with Current Buffer (This can be ignored if wished) I find it better to both add and multiply
-    juce::FloatVectorOperations::multiply(noiseBuffer.getWritePointer(0), currentOutputBuffer.getWritePointer(0), numSamples);
-    juce::FloatVectorOperations::multiply(noiseBuffer.getWritePointer(1), currentOutputBuffer.getWritePointer(1), numSamples);
-
-    //Then Add Noise As Well
-    currentOutputBuffer.addFrom(0, 0, noiseBuffer.getReadPointer(0), numSamples);
-    currentOutputBuffer.addFrom(1, 0, noiseBuffer.getReadPointer(1), numSamples);
+            if (auto bpm = position->getBpm())
+                beatsPerMinute = *bpm;
+        }
+    }
     
-    //Here the resampling and bit crushing occurs, this is a very generic procedure for bitcrushing as my research shows
-    for (int chan = 0; chan < currentOutputBuffer.getNumChannels(); chan++)
+    samplesProcessed = blockPosition + numSamples;
+    lastBeatsPerMinute.store(beatsPerMinute);
+    
+    const bool deterministicNoise = *noiseDeterministic > 0.5f;
+    const int numNoiseChannels = *noiseStereo > 0.5f ? juce::jmin(buffer.getNumChannels(), noiseBuffer.getNumChannels()) : 1;
+    noiseMaker.setDeterministicSeed((juce::uint32) *noiseSeed);
+    
+    const auto colour = static_cast<NoiseGenerators::Colour> (static_cast<int> (*noiseColour));
+    noiseMaker.setVelvetDensity(*velvetDensity);
+    
+    //The detune and LFO parameters go to the synth once, for every voice (see "VoiceBank.h")
+    synth.setDetune(*detuneParam);
+    synth.setLFOFreq(lfoSpeedSmoother.process(numSamples));
+    synth.setLFOAudioRate(*lfoAudioRate > 0.5f);
+    synth.openDetune(*detuneOn);
+    synth.setDetuneMix(detuneMixSmoother.process(numSamples));
+    synth.getVoiceBank().setWorkerPool(&renderWorkers, (int) *renderThreads);
+    synth.setPolyphony((int) *polyphony);
+    synth.setVelocitySensitivity(*velocitySensitivity);
+    synth.setEnvelope(*attackParam, *decayParam, *sustainParam, *releaseParam,
+                      static_cast<BlockEnvelope::Shape> (static_cast<int> (*envShape)));
+    synth.setUnison((int) *unison, *unisonDetune, *unisonWidth, *unisonPhase);
+    synth.setOperatorRouting(static_cast<VoiceBank::Routing> (static_cast<int> (*pmRouting)), *pmDepth);
+    synth.setPulse(*oscShape > 0.5f, *pulseWidth);
+
+    //Adding Our Midi Samples from our Synth straight onto the host buffer, the input or silence. Switched off, its notes
+    //are let go and it plays on only until their releases end, with no new ones. After that it costs nothing
+    const bool synthPlays = *synthOn > 0.5f;
+    
+    if (synthWasOn && ! synthPlays)
+        synth.allNotesOff(0, true);
+    
+    synthWasOn = synthPlays;
+    
+    if (synthPlays)
+        synth.renderNextBlock(buffer, midiMessages, 0, numSamples);
+    else if (synth.getVoiceBank().getNumActive() > 0)
+        synth.renderNextBlock(buffer, noMidi, 0, numSamples);
+    
+    /*
+     Here the noise, the bit crushing and the resampling occur, in a single pass over the buffer (see "BitCrusher.h").
+     The noise is both multiplied with the signal and added to it, I find it better to both add and multiply.
+     Then the bit depth is reduced, and the sample and hold keeps its clock across blocks so it sounds the same at any buffer size.
+     */
+    crusher.setBitDepth(bitDepth);
+    crusher.setRateReduction(rateDivide);
+    
+    //This is for security reasons: if the host sends a bigger block than it told prepareToPlay, work through it in pieces
+    //that fit the noise buffer rather than allocating on the audio thread
+    const int chunkSize = noiseBuffer.getNumSamples() > 0 ? noiseBuffer.getNumSamples() : numSamples;
+    
+    for (int start = 0; start < numSamples; start += chunkSize)
     {
-        float* data = currentOutputBuffer.getWritePointer(chan);
-
-        for (int i = 0; i < numSamples; i++)
+        const int num = juce::jmin(chunkSize, numSamples - start);
+        
+        //Building Noise. Only when it is going to be heard, at -100dB and below the gain is 0
+        const float* const* noise = nullptr;
+        
+        if (noiseOn && colour == NoiseGenerators::Colour::velvet)
         {
-           
-            // REDUCE BIT DEPTH
-            float totalQLevels = powf(2 , bitDepth);
-            float val = data[i];
-            float remainder = fmodf(val, 1 / totalQLevels);
-
-            // Quantize ...
-            data[i] = val - remainder;
-
-            if (rateDivide > 1)
+            //Velvet noise is sparse, so it goes straight onto the signal at its impulses and the crusher gets no noise
+            for (int chan = 0; chan < buffer.getNumChannels(); chan++)
+                noiseMaker.applyVelvetNoise(buffer.getWritePointer(chan, start), num, noiseAmt.from(start), blockPosition + start,
+                                            juce::jmin(chan, numNoiseChannels - 1), deterministicNoise);
+        }
+        else if (noiseOn && noiseBuffer.getNumSamples() > 0)
+        {
+            //Chose to Use White Noise,Could Be Simple Noise As Well
+            for (int chan = 0; chan < numNoiseChannels; chan++)
             {
-                if (i%rateDivide != 0)
-                    data[i] = data[i - i % rateDivide];
+                if (deterministicNoise)
+                    noiseMaker.fillDeterministicNoise(noiseBuffer.getWritePointer(chan), num, blockPosition + start, chan);
+                else
+                    noiseMaker.fillWhiteNoise(noiseBuffer.getWritePointer(chan), num);
+                
+                noiseMaker.colourNoise(noiseBuffer.getWritePointer(chan), num, colour, chan);
             }
+            
+            noise = noiseBuffer.getArrayOfReadPointers();
         }
+        
+        crusher.process(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, num, noise, numNoiseChannels, noiseAmt);
     }
+    
+    //The chorus, flanger or tape wobble, in place
+    modMixSmoother.setTargetValue(*modMix);
+    modDelay.setMode((MultiTapDelay::Mode) (int) *modMode);
+    modDelay.setNumTaps((int) *modTaps);
+    modDelay.setRate(*modRate);
+    modDelay.setDepth(*modDepth);
+    modDelay.process(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), 0, numSamples, modMixSmoother.process(numSamples));
+    
+    //The echo of the crushed sound, added on in place
+    echoMixSmoother.setTargetValue(*echoMix);
+    echo.setInterpolation((DelayInterpolation::Type) (int) *echoInterpolation);
+    echo.setDelayTime(getEchoSeconds(beatsPerMinute));
+    echo.setFeedback(*echoFeedback);
+    echo.process(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), 0, numSamples, echoMixSmoother.process(numSamples));
+}
 
-    //Copy the currentOutputbuffer to our final main buffer
-    buffer.copyFrom(0, 0, currentOutputBuffer, 0, 0, numSamples);
-    buffer.copyFrom(1, 0, currentOutputBuffer, 1, 0, numSamples);
+double MidiTryAudioProcessor::getEchoSeconds(double beatsPerMinute) const
+{
+    return *echoSync > 0.5f ? Echo::getSyncedSeconds((int) *echoDivision, beatsPerMinute) : *echoTime / 1000.0;
+}
 
+float MidiTryAudioProcessor::getNoiseGain() const
+{
+    //Noise parameterss and variables
+    float noiseAmt = -120 + 120 * (*noiseParam / 100); // dB
+    noiseAmt = juce::jlimit<float>(-120, 0, noiseAmt);       // limit (?)
+    noiseAmt = juce::Decibels::decibelsToGain(noiseAmt);     // dB to gain
     
-    //This can be used for future use as well, so let this stay here
-//    juce::FloatVectorOperations::add(buffer.getWritePointer(0), currentOutputBuffer.getReadPointer(0), numSamples);
-//    juce::FloatVectorOperations::add(buffer.getWritePointer(1), currentOutputBuffer.getReadPointer(1), numSamples);
+    // Range Bound fo Noise
+    return juce::jlimit<float>(0, 1, noiseAmt);
 }
 
 //==============================================================================
@@ -11,6 +11,11 @@
 #include <JuceHeader.h>
 #include "MySynth.h"
 #include "NoiseGenerator.h"
+#include "BitCrusher.h"
+#include "ParamSmoother.h"
+#include "DspArena.h"
+#include "Echo.h"
+#include "MultiTapDelay.h"
 
 //==============================================================================
 /**
@@ -58,17 +63,18 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
     juce::AudioProcessorValueTreeState parameters;
+
+    /// What one voice of the pool takes, in bytes, as last prepared: its share of the voice bank and the voice itself
+    size_t getMemoryPerVoice() const;
 private:
 
     
-    //Two new buffers to hold the generated noise and resampled and bit depthed samples
-    juce::AudioSampleBuffer noiseBuffer, currentOutputBuffer;
-
     // Atomic floats for ValueTree parameters
     std::atomic<float>* detuneParam;
     
     std::atomic<float>* detuneMix;
     std::atomic<float>* rateOfLFO;
+    std::atomic<float>* lfoAudioRate;
 
     std::atomic<float>* detuneOn;
     
@@ -76,16 +82,97 @@ private:
     std::atomic<float>* rateParam;
     std::atomic<float>* bitsParam;
     
+    std::atomic<float>* noiseDeterministic;
+    std::atomic<float>* noiseSeed;
+    std::atomic<float>* noiseStereo;
+    std::atomic<float>* noiseColour;
+    std::atomic<float>* velvetDensity;
+    
+    std::atomic<float>* renderThreads;
+    std::atomic<float>* polyphony;
+    std::atomic<float>* velocitySensitivity;
+    
+    std::atomic<float>* attackParam;
+    std::atomic<float>* decayParam;
+    std::atomic<float>* sustainParam;
+    std::atomic<float>* releaseParam;
+    std::atomic<float>* envShape;
+    
+    std::atomic<float>* unison;
+    std::atomic<float>* unisonDetune;
+    std::atomic<float>* unisonWidth;
+    std::atomic<float>* unisonPhase;
+    
+    std::atomic<float>* pmRouting;
+    std::atomic<float>* pmDepth;
+    std::atomic<float>* oscShape;
+    std::atomic<float>* pulseWidth;
+    
+    std::atomic<float>* echoMix;
+    std::atomic<float>* echoTime;
+    std::atomic<float>* echoSync;
+    std::atomic<float>* echoDivision;
+    std::atomic<float>* echoFeedback;
+    std::atomic<float>* echoInterpolation;
+    
+    std::atomic<float>* modMode;
+    std::atomic<float>* modMix;
+    std::atomic<float>* modRate;
+    std::atomic<float>* modDepth;
+    std::atomic<float>* modTaps;
+    
+    std::atomic<float>* synthOn;
+    
+    
+    //One slab for the scratch spans and delay buffers of all the DSP below, sized in prepareToPlay (see "DspArena.h").
+    //Declared first, so it outlives everything that points into it
+    DspArena arena;
     
-    //Calling JUCE's synth class
-    juce::Synthesiser synth;
+    //Threads that can share the voice rendering with the audio thread. Started in prepareToPlay when "Render Threads" is on
+    RealtimeWorkerPool renderWorkers;
+    
+    //Calling JUCE's synth class, with all the voices rendered together (see "VoiceBank.h")
+    MySynth synth;
+    
+    //The synth's switch as of the last block, and the MIDI it gets once it is off: none
+    bool synthWasOn = true;
+    juce::MidiBuffer noMidi;
     
     
     //Calling Noise Class
     NoiseGenerators noiseMaker;
     
-    //For the polyphony and how many sounds can be processed at once on the output buffer
-    int voiceCount = 20;
+    //Holds one block of noise, in the arena
+    juce::AudioSampleBuffer noiseBuffer;
+    
+    //Our own count of the timeline position, for when the host has no play head or is stopped
+    juce::int64 samplesProcessed = 0;
+    
+    //The host's tempo as of the last block, for the tail of the synced echo. Read from other threads
+    std::atomic<double> lastBeatsPerMinute { 120.0 };
+    
+    //Noise, bit depth and sample rate reduction, fused into one pass
+    BitCrusher crusher;
+    
+    //Parameters that ramp over a few milliseconds when they change, so automating them doesn't step every block
+    ParamSmoother bitsSmoother, noiseGainSmoother, detuneMixSmoother, lfoSpeedSmoother, echoMixSmoother, modMixSmoother;
+    
+    //The chorus, flanger or tape wobble after the crusher, then the feedback echo
+    MultiTapDelay modDelay;
+    Echo echo;
+    
+    //The "Noise" parameter as a gain
+    float getNoiseGain() const;
+    
+    //The echo's time, in seconds, from its parameters and the tempo
+    double getEchoSeconds(double beatsPerMinute) const;
+    
+    //Prepares everything that takes memory from the arena. prepareToPlay runs it twice: to lay the arena out, then onto it
+    void prepareArenaModules(double sampleRate, int samplesPerBlock);
+    
+    //How many voices are made up front. The "Polyphony" parameter picks how many of them can sound at once, so changing it
+    //never allocates
+    static constexpr int maxVoices = 512;
    
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiTryAudioProcessor)
@@ -0,0 +1,275 @@
+/*
+  ==============================================================================
+
+    RealtimeWorkerPool.h
+    Created: 17 Oct 2026 6:12:40pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#elif JUCE_WINDOWS
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+#else
+ #include <cerrno>
+ #include <semaphore.h>
+#endif
+
+/**
+ The operating system's own counting semaphore. Unlike juce::WaitableEvent, which takes a mutex the waiting thread also
+ holds, post() is an atomic increment and at most a system call to wake the waiter, so the audio thread can call it
+ without ever waiting on a lower priority thread.
+ */
+class RealtimeSemaphore
+{
+public:
+    RealtimeSemaphore()
+    {
+       #if JUCE_MAC || JUCE_IOS
+        semaphore = dispatch_semaphore_create(0);
+       #elif JUCE_WINDOWS
+        semaphore = CreateSemaphoreW(nullptr, 0, 0x7fffffff, nullptr);
+       #else
+        sem_init(&semaphore, 0, 0);
+       #endif
+    }
+
+    ~RealtimeSemaphore()
+    {
+       #if JUCE_MAC || JUCE_IOS
+        dispatch_release(semaphore);
+       #elif JUCE_WINDOWS
+        CloseHandle(semaphore);
+       #else
+        sem_destroy(&semaphore);
+       #endif
+    }
+
+    /// Let one wait() through, now or the next time one is called
+    void post()
+    {
+       #if JUCE_MAC || JUCE_IOS
+        dispatch_semaphore_signal(semaphore);
+       #elif JUCE_WINDOWS
+        ReleaseSemaphore(semaphore, 1, nullptr);
+       #else
+        sem_post(&semaphore);
+       #endif
+    }
+
+    /// Sleep until a post()
+    void wait()
+    {
+       #if JUCE_MAC || JUCE_IOS
+        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+       #elif JUCE_WINDOWS
+        WaitForSingleObject(semaphore, INFINITE);
+       #else
+        while (sem_wait(&semaphore) != 0 && errno == EINTR) {}
+       #endif
+    }
+
+private:
+   #if JUCE_MAC || JUCE_IOS
+    dispatch_semaphore_t semaphore;
+   #elif JUCE_WINDOWS
+    HANDLE semaphore;
+   #else
+    sem_t semaphore;
+   #endif
+
+    JUCE_DECLARE_NON_COPYABLE (RealtimeSemaphore)
+};
+
+/**
+ A few real-time threads that help the audio thread through a job split into numbered tasks.
+
+ The threads are made up front in start(), so run() never allocates, locks or creates anything. The audio thread wakes as
+ many workers as it wants with a RealtimeSemaphore each, then takes tasks itself alongside them, and returns once every
+ task is done. Tasks are handed out from one atomic counter: whoever is free takes the next one, so a worker that wakes
+ late or gets interrupted just ends up doing fewer. Which thread does which task changes from run to run, so a job that
+ has to come out the same every time gives each task its own output and adds them up in task order afterwards (see
+ "VoiceBank.h").
+
+ Once its own tasks run out, the audio thread waits for the ones still running on the workers. It yields for a while,
+ and if they still aren't done (a worker was preempted) it sleeps on a semaphore the last task posts, rather than
+ spinning for as long as the worker is away. It only returns once it has counted every task done, however it was woken.
+
+ With no workers started, or a job of one task, run() does the tasks in order on the calling thread.
+ */
+class RealtimeWorkerPool
+{
+public:
+    /// Work that can be done in numbered pieces, any piece on any thread, in any order
+    struct Job
+    {
+        virtual ~Job() = default;
+        virtual void runTask(int task) = 0;
+    };
+
+    ~RealtimeWorkerPool()
+    {
+        stop();
+    }
+
+    /**
+     Start the worker threads (stopping any that are running). Creates threads: call from prepareToPlay or the message
+     thread, never while run() could be called.
+
+     @param numWorkers how many threads to start, not counting the audio thread
+     @param blockMs the length of an audio block. The system is told the workers have to finish within it.
+     */
+    void start(int numWorkers, double blockMs)
+    {
+        stop();
+
+        for (int i = 0; i < numWorkers; i++)
+            workers.push_back(std::make_unique<Worker>(*this, i));
+
+        //Before JUCE 7.0.3 there are no real-time options: the threads just get the audio priority
+        for (auto& worker : workers)
+           #if JUCE_VERSION >= 0x70003
+            worker->startRealtimeThread(juce::Thread::RealtimeOptions().withMaximumProcessingTimeMs(blockMs));
+           #else
+            worker->startThread(juce::Thread::realtimeAudioPriority);
+           #endif
+
+        juce::ignoreUnused(blockMs);
+    }
+
+    /// Stop and delete the worker threads. Not from the audio thread.
+    void stop()
+    {
+        for (auto& worker : workers)
+            worker->signalThreadShouldExit();
+
+        for (auto& worker : workers)
+        {
+            worker->wake.post();
+            worker->stopThread(1000);
+        }
+
+        workers.clear();
+    }
+
+    int getNumWorkers() const       { return (int) workers.size(); }
+
+    /**
+     Do every task of a job and return when they are all done. The calling thread works on the job too.
+
+     @param job what to run
+     @param numTasks tasks 0 to numTasks - 1 are run once each
+     @param maxHelpers how many workers to wake for it at most
+     */
+    void run(Job& job, int numTasks, int maxHelpers)
+    {
+        const int numHelpers = juce::jmin(maxHelpers, getNumWorkers(), numTasks - 1);
+
+        if (numHelpers <= 0)
+        {
+            for (int task = 0; task < numTasks; task++)
+                job.runTask(task);
+
+            return;
+        }
+
+        currentJob = &job;
+        tasksDone.store(0, std::memory_order_relaxed);
+
+        //The number of tasks sits in the top half of the counter and the next task in the bottom half. A worker still
+        //holding on from the last job can only ever draw a ticket past the end of its job, or a real task of this one.
+        nextTicket.store((uint64_t) numTasks << 32, std::memory_order_release);
+
+        for (int i = 0; i < numHelpers; i++)
+            workers[(size_t) i]->wake.post();
+
+        work();
+
+        for (int spin = 0; spin < spinsBeforeSleeping && tasksDone.load(std::memory_order_acquire) < numTasks; spin++)
+            juce::Thread::yield();
+
+        //Either the last task sees the flag and posts, or it was done before the flag went up. If the flag is gone by
+        //then, a post is on its way anyway: take it, so it isn't left over for the next run. The post can also come from
+        //the last task of the run before, if its worker was preempted between finishing and taking the flag down. So a
+        //wake-up only means "look again", and the job is only over once every task is counted
+        while (tasksDone.load(std::memory_order_acquire) < numTasks)
+        {
+            audioThreadWaiting.store(true);
+
+            if (tasksDone.load() < numTasks || ! audioThreadWaiting.exchange(false))
+                finished.wait();
+        }
+    }
+
+private:
+    /// How many times the audio thread yields waiting for the workers' last tasks, before it sleeps until they're done
+    static constexpr int spinsBeforeSleeping = 1000;
+
+    /// Take tasks until there are none left
+    void work()
+    {
+        for (;;)
+        {
+            const uint64_t ticket = nextTicket.fetch_add(1, std::memory_order_acq_rel);
+            const int task = (int) (ticket & 0xffffffffu);
+            const int numTasks = (int) (ticket >> 32);
+
+            if (task >= numTasks)
+                return;
+
+            currentJob->runTask(task);
+
+            //The last task to finish wakes the audio thread, if it has gone to sleep waiting for it
+            if (tasksDone.fetch_add(1) + 1 == numTasks && audioThreadWaiting.exchange(false))
+                finished.post();
+        }
+    }
+
+    struct Worker : public juce::Thread
+    {
+        Worker(RealtimeWorkerPool& p, int index)
+            : juce::Thread("Render worker " + juce::String(index)),
+              pool(p)
+        {
+        }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                wake.wait();
+
+                if (threadShouldExit())
+                    break;
+
+                //The same floating point mode as the audio thread
+                juce::ScopedNoDenormals noDenormals;
+                pool.work();
+            }
+        }
+
+        RealtimeWorkerPool& pool;
+        RealtimeSemaphore wake;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    Job* currentJob = nullptr;
+    std::atomic<uint64_t> nextTicket { 0 };
+    std::atomic<int> tasksDone { 0 };
+
+    RealtimeSemaphore finished;
+    std::atomic<bool> audioThreadWaiting { false };
+};
@@ -0,0 +1,140 @@
+/*
+  ==============================================================================
+
+    SampleHold.h
+    Created: 17 Oct 2026 11:03:41am
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DspArena.h"
+#include "FixedPointPhase.h"
+
+/**
+ Sample rate reduction by sample-and-hold, driven by a phase accumulator.
+
+ The old code held "data[i - i % rateDivide]". That starts again at every host block, so the sound depended on the buffer
+ size, and only whole number factors were possible. This class keeps the clock phase and the held value of every channel
+ between calls to process(). A bounce at 2048 samples per block then matches realtime playback at 64, and the ratio can be
+ fractional (e.g. 2.5 holds a new value every two and a half samples on average).
+
+ The clock counts down the samples left until the next capture and adds the ratio back each time it fires. Whole number
+ and half ratios only ever pass through exactly representable float values, so they never drift. With ALPACON_PHASE_BITS
+ set (see "FixedPointPhase.h") it counts in fixed point instead, so no ratio drifts.
+ */
+class SampleHold
+{
+public:
+   #if ALPACON_PHASE_BITS
+    using Countdown = FixedPointPhase::Clock;
+   #else
+    using Countdown = float;
+   #endif
+
+    /// Takes the held value of every channel from the arena: call from prepareToPlay
+    void prepare(int numChannels, DspArena& arena)
+    {
+        numHeld = juce::jmax(numChannels, 1);
+        held = arena.allocate<float>((size_t) numHeld);
+        reset();
+    }
+
+    /// Forget the held values. The next sample processed is always captured.
+    void reset()
+    {
+        std::fill(held, held + numHeld, 0.0f);
+        countdown = 0;
+    }
+
+    /**
+     Set the reduction ratio. 1 (or less) means no reduction, 2 holds every value for two samples, 2.5 for two and a half
+     samples on average. Call once per block.
+     */
+    void setRatio(float newRatio)
+    {
+        ratio = newRatio;
+        ratioCountdown = toCountdown(newRatio);
+    }
+
+    /// Is the hold doing anything at the current ratio?
+    bool isActive() const       { return ratio > 1.0f; }
+
+    /// Hold the samples of every channel in place. All channels share one clock.
+    void process(float* const* channels, int numChannels, int numSamples)
+    {
+        if (! isActive())
+        {
+            //Start cleanly when the reduction comes back on
+            countdown = 0;
+            return;
+        }
+
+        const Countdown startCountdown = beginBlock();
+        Countdown endCountdown = startCountdown;
+
+        for (int chan = 0; chan < numChannels; chan++)
+            endCountdown = processSpan(chan, channels[chan], numSamples, startCountdown);
+
+        endBlock(endCountdown);
+    }
+
+    /**
+     For loops that walk the block in pieces (see "BitCrusher.h"): every channel starts from the value returned here, feeds
+     it through processSpan() piece by piece, and the last channel's value goes back in with endBlock().
+     */
+    Countdown beginBlock()
+    {
+        //Keep the clock in range when the ratio goes down, so the next capture comes at once rather than after a long wait
+        countdown = juce::jmin(countdown, ratioCountdown - oneSample);
+        return countdown;
+    }
+
+    /// One pass over a span of a channel. The selects compile to branch free code.
+    Countdown processSpan(int chan, float* data, int numSamples, Countdown startCountdown)
+    {
+        jassert(chan < numHeld);
+
+        const Countdown r = ratioCountdown;
+        const Countdown one = oneSample;
+        Countdown c = startCountdown;
+        float h = held[chan];
+
+        for (int i = 0; i < numSamples; i++)
+        {
+            const bool capture = c <= 0;
+            h = capture ? data[i] : h;
+            c += (capture ? r : 0) - one;
+            data[i] = h;
+        }
+
+        held[chan] = h;
+        return c;
+    }
+
+    void endBlock(Countdown endCountdown)
+    {
+        countdown = endCountdown;
+    }
+
+private:
+    static Countdown toCountdown(float samples)
+    {
+       #if ALPACON_PHASE_BITS
+        return FixedPointPhase::clockFromSamples(samples);
+       #else
+        return samples;
+       #endif
+    }
+
+    float* held = nullptr;
+    int numHeld = 0;
+    float ratio = 1.0f;
+    Countdown ratioCountdown = toCountdown(1.0f);
+    Countdown oneSample = toCountdown(1.0f);
+
+    //Samples left until the next capture. The phase of the clock, counted in samples.
+    Countdown countdown = 0;
+};
@@ -0,0 +1,1137 @@
+/*
+  ==============================================================================
+
+    VoiceBank.h
+    Created: 17 Oct 2026 5:02:19pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+#include "BlockEnvelope.h"
+#include "DspArena.h"
+#include "FixedPointPhase.h"
+#include "ParamSmoother.h"
+#include "RealtimeWorkerPool.h"
+#include "SineKernels.h"
+#include "Wavetable.h"
+
+/**
+ The DSP of every voice of the synth, stored as a structure of arrays and rendered in one loop.
+
+ Each voice used to be its own object: a wavetable osc, two sines and a juce::ADSR, rendered one after the other by
+ juce::Synthesiser. Here every piece of voice state (phases, increments, envelope levels and rates, gains) is an array with
+ one entry per voice, a "slot". The render loop runs across the slots, a group of "lanes" slots at a time, so the compiler
+ works on a whole group in one set of vector instructions. A big chord then costs far less than that many single notes.
+
+ "MySynthVoice" is the handle juce::Synthesiser sees: it keeps note on and note off, and forwards them here. A voice only
+ has slots while it sounds. The sounding slots always fill the bank from 0 up, with no gaps: a new note takes the next
+ free slots, and when a note dies away the slots after it move down, in order, to close the gap. Rendering, the per-block parameter updates
+ and the end-of-note check then only ever touch the sounding slots, so idle voices cost nothing, however many there are.
+ "MySynth" renders the whole bank in renderVoices().
+
+ In unison (setUnison()) a note takes one slot per copy. Each copy is a whole voice of its own, detuned, panned and
+ started from its own phase, and the copies render side by side in the lanes like any other slots. There are as many slots
+ as voices, so the notes that can sound at once times the unison has to fit in that (see hasRoomForNote()).
+
+ The envelope is a "BlockEnvelope": each slot knows how many samples are left in its stage, so a group renders in spans
+ that end where the first of its slots changes stage. Inside a span every envelope is a plain ramp, with no test per
+ sample, and a slot whose release has run out is idle, at 0, from that exact sample on. Nothing in the loop is a select, so
+ it vectorizes even when floating point exceptions are on (GCC's default): the compiler won't work out a value it might not
+ need then, so "c ? a - 1 : a" would stop the whole loop from vectorizing.
+
+ The detune LFO runs at a control rate: every controlInterval samples, on a clock of its own, each slot works out its LFO
+ and heads for that value in a straight line over the next interval. So the modulation is the same whatever the host's
+ block size or wherever the MIDI splits it, and it costs one sine per slot per interval. With setLFOAudioRate() it is
+ worked out at every sample instead, for modulation too fast for that.
+
+ The detune mix and the LFO rate come in as "SmoothedSpan"s, so automating them doesn't step once per block. The mix is
+ read at every sample, the LFO rate at every control point (or every sample at audio rate). A steady one is read through a
+ stride of 0, so neither form costs a branch per sample.
+
+ A voice has two oscillators, the triangle (or a pulse, see setPulse()) and the detune sine. By default they are mixed. With setOperatorRouting() one
+ moves the other's phase, sample by sample (phase modulation, the FM of the DX7): the modulator is worked out first in the
+ lane loop and goes straight into the carrier's phase, so the chain stays in vector registers. The routing is a template
+ argument of the render loop, so the plain mix costs nothing extra.
+
+ The groups are rendered in tasks of a few groups each. Every task has its own lane mix, and the tasks are added up in
+ order at the end, so the output is the same whether the tasks run one after the other or across the threads of a
+ "RealtimeWorkerPool" (see setWorkerPool()).
+ */
+class VoiceBank : private RealtimeWorkerPool::Job
+{
+public:
+    /// Slots rendered together. Four floats fill an SSE or NEON register, the ones every Mac has.
+    static constexpr int lanes = 4;
+
+    /// Groups of slots in one task: the most a single thread ever renders by itself is 16 voices
+    static constexpr int groupsPerTask = 4;
+
+    /// Samples between the points where the LFO is worked out, when it isn't at audio rate
+    static constexpr int controlInterval = 16;
+
+    /// The most copies of a note in unison
+    static constexpr int maxUnison = 16;
+
+    /// How a voice's two oscillators are wired together (see setOperatorRouting())
+    enum Routing
+    {
+        mix = 0,                    ///< both heard, in the detune mix
+        sineModulatesTriangle,      ///< the detune sine moves the triangle's phase
+        triangleModulatesSine,      ///< the triangle moves the detune sine's phase
+        numRoutings
+    };
+
+    /// Register a new voice and get its number. Call from the voice's constructor, before prepare().
+    int addVoice()
+    {
+        return numVoices++;
+    }
+
+    int getNumVoices() const    { return numVoices; }
+
+    /// How many slots are in use. Without unison, one per sounding voice.
+    int getNumActive() const    { return numActive; }
+
+    /// How many voices are sounding
+    int getNumPlaying() const   { return numPlaying; }
+
+    /// Whether a new note on a free voice would get all its unison copies
+    bool hasRoomForNote() const { return numActive + unisonCount <= numVoices; }
+
+    /// Allocate all the arrays and scratch space. Call from prepareToPlay, not on the audio thread.
+    void prepare(double newSampleRate, int maxBlockSize, DspArena& arena)
+    {
+        sampleRate = (float) newSampleRate;
+        blockSize = juce::jmax(maxBlockSize, 1);
+
+        //Every voice could be sounding at once, and the last group of slots is always rendered whole
+        const size_t numSlots = (size_t) (((numVoices + lanes - 1) / lanes) * lanes);
+
+        forEachSlotArray(*this, [numSlots] (auto& array) { array.assign(numSlots, {}); });
+        std::fill(voiceOfSlot.begin(), voiceOfSlot.end(), -1);
+
+        const size_t voices = (size_t) numVoices;
+        slotsOfVoice.assign(voices * maxUnison, -1);
+        copiesOfVoice.assign(voices, 0);
+        voiceGain.assign(voices, 1.0f);
+
+        for (auto* array : { &voiceOscPhase, &voiceDetunePhase, &voiceLfoPhase })
+            array->assign(voices, Phase());
+
+        finishedVoices.clear();
+        finishedVoices.reserve(voices);
+        numActive = 0;
+        numPlaying = 0;
+
+        maxTasks = juce::jmax(1, (((int) numSlots / lanes) + groupsPerTask - 1) / groupsPerTask);
+
+        for (int side = 0; side < 2; side++)
+        {
+            laneMix[side] = arena.allocate<float>((size_t) (maxTasks * blockSize * lanes));
+            sideMix[side] = arena.allocate<float>((size_t) blockSize);
+        }
+
+        triangle = wavetables->getTable(WavetableBank::triangle).getLevel(0);
+        saw = wavetables->getTable(WavetableBank::saw).getLevel(0);
+        envelope.setSampleRate(newSampleRate);
+        setDetune(detuneAmount);
+        lfoDeltaRamp = arena.allocate<Phase>((size_t) blockSize);
+        setDetuneMix({ nullptr, detuneMix.value });
+        setLFOFrequency({ nullptr, lfoFrequency });
+        controlClock = 0;
+    }
+
+    /**
+     Set the ADSR of every slot. Cheap when nothing has changed, so it can be called every block. The new times are used
+     from the next stage a note starts, and a sustaining note moves to the new sustain level straight away.
+     */
+    void setEnvelope(const juce::ADSR::Parameters& newParams, BlockEnvelope::Shape shape = BlockEnvelope::linear)
+    {
+        const auto& current = envelope.getParameters();
+
+        if (newParams.attack == current.attack && newParams.decay == current.decay && newParams.sustain == current.sustain
+             && newParams.release == current.release && shape == envelope.getShape())
+            return;
+
+        envelope.setParameters(newParams, shape);
+
+        for (int s = 0; s < numActive; s++)
+            if (envStage[(size_t) s] == BlockEnvelope::sustain)
+                setSegment(s, envelope.next(BlockEnvelope::sustain, newParams.sustain, envLevel[(size_t) s]));
+    }
+
+    //==========================================================================
+    // Called by the voices, from inside juce::Synthesiser's MIDI handling
+
+    void startNote(int voice, float noteFrequency)
+    {
+        const size_t v = (size_t) voice;
+
+        //A voice that is stolen or retriggered keeps its slots, unless the unison has changed since
+        const int numCopies = juce::jmin(unisonCount, numVoices - numActive + copiesOfVoice[v]);
+        jassert(numCopies > 0);
+
+        if (copiesOfVoice[v] != numCopies)
+        {
+            dropSlots(voice);
+
+            for (int copy = 0; copy < numCopies; copy++)
+                takeSlot(voice, copy);
+
+            copiesOfVoice[v] = numCopies;
+            numPlaying++;
+        }
+
+        float level = 0.0f;
+        const auto seg = envelope.noteOn(level);
+
+        for (int copy = 0; copy < numCopies; copy++)
+        {
+            const size_t s = (size_t) slotsOfVoice[v * maxUnison + (size_t) copy];
+
+            //The copies spread evenly from -1 to 1, in pitch (cents) and in pan
+            const float position = numCopies > 1 ? (2.0f * (float) copy / (float) (numCopies - 1)) - 1.0f : 0.0f;
+            const float copyFrequency = noteFrequency * std::exp2(position * unisonSpread / 1200.0f);
+            unisonPan[s] = position * unisonWidth;
+
+            //The per sample code stepped the triangle twice every sample, so it has always sounded an octave above the note
+            const float delta = (copyFrequency * 2.0f) / sampleRate;
+            oscDelta[s] = toPhaseDelta(copyFrequency * 2.0f);
+            oscLevel[s] = (int) (wavetables->getTable(WavetableBank::triangle).getLevel(Wavetable::getLevelFor(delta)) - triangle);
+
+            //The first copy carries on from the voice's last note, the others start somewhere of their own
+            if (copy > 0)
+            {
+                oscPhase[s] = step(oscPhase[s], randomPhase());
+                detunePhase[s] = step(detunePhase[s], randomPhase());
+            }
+
+            //The detune osc sits on the note, and the LFO takes it down from there. Until the next control point it holds
+            detuneCentre[s] = toPhaseDelta(copyFrequency);
+            detuneDelta[s] = detuneTarget[s] = detuneFromLFO(detuneCentre[s], lfoPhase[s]);
+            detuneStep[s] = Phase();
+
+            envLevel[s] = level;
+            setSegment((int) s, seg);
+        }
+
+        updatePan(voice);
+    }
+
+    void stopNote(int voice)
+    {
+        const size_t v = (size_t) voice;
+
+        for (int copy = 0; copy < copiesOfVoice[v]; copy++)
+        {
+            const size_t s = (size_t) slotsOfVoice[v * maxUnison + (size_t) copy];
+            setSegment((int) s, envelope.noteOff(envLevel[s]));
+        }
+    }
+
+    //==========================================================================
+    // The synth's parameters, the same for every voice. Set them once per block.
+
+    /// The ramps of these spans run from the start of the block, and must last until it is rendered. Set them every block.
+    void setDetuneMix(const SmoothedSpan& mix)      { detuneMix = mix; }
+    void setDetuneOn(bool isOn)                     { detuneOn = isOn ? 1.0f : 0.0f; }
+
+    /// How far the LFO takes the detune osc below the note, in Hz
+    void setDetune(float amount)
+    {
+        detuneAmount = amount;
+
+       #if ALPACON_PHASE_BITS
+        detuneScale = std::ldexp(amount / sampleRate, FixedPointPhase::bits);
+       #else
+        detuneScale = amount / sampleRate;
+       #endif
+    }
+
+    void setLFOFrequency(const SmoothedSpan& freq)
+    {
+        lfoRamp = freq.ramp;
+        lfoFrequency = freq.value;
+        lfoDelta = toPhaseDelta(lfoFrequency);
+        lfoControlDelta = toPhaseDelta(lfoFrequency * (float) controlInterval);
+    }
+
+    /// Work the LFO out at every sample rather than at the control points. Costs a sine per voice per sample.
+    void setLFOAudioRate(bool shouldBeAudioRate)
+    {
+        lfoAudioRate = shouldBeAudioRate;
+    }
+
+    /**
+     Unison, for the notes that start from now on. 1 copy is a plain voice.
+
+     @param numCopies how many copies of each note, 1 to maxUnison
+     @param spreadCents how far the outermost copies are detuned, up and down
+     @param width how far the outermost copies are panned, 0 to 1
+     @param phaseRandomness how much of a cycle the copies' start phases are scattered over, 0 to 1
+     */
+    void setUnison(int numCopies, float spreadCents, float width, float phaseRandomness)
+    {
+        unisonCount = juce::jlimit(1, maxUnison, numCopies);
+        unisonSpread = spreadCents;
+        unisonWidth = width;
+        unisonPhase = phaseRandomness;
+    }
+
+    /**
+     Phase modulation between the oscillators. Both are still mixed by the detune mix, so with the mix at 0 (or the detune
+     off) only the triangle is heard, and a sine modulating it is heard as its change of timbre.
+
+     @param newRouting which oscillator modulates which
+     @param depth how far the modulator moves the carrier's phase, in cycles per unit of the modulator's output. The
+                  triangle is quiet (+-0.25), so it needs four times the depth of the sine for the same effect.
+     */
+    void setOperatorRouting(Routing newRouting, float depth)
+    {
+        routing = (Routing) juce::jlimit(0, numRoutings - 1, (int) newRouting);
+        pmDepth = juce::jlimit(-maxPMDepth, maxPMDepth, depth);
+    }
+
+    /**
+     Play a pulse instead of the triangle. It is the saw from a pulse width ago less the saw now, both read from the saw
+     wavetable, so the width can change every block and never aliases. It has the level of the triangle (+-0.25): up for
+     the first part of the cycle, as wide as the width, and down for the rest.
+
+     @param on the pulse, or the triangle
+     @param width the pulse width, 0 to 1
+     */
+    void setPulse(bool on, float width)
+    {
+        pulse = on;
+        pulseWidth = juce::jlimit(0.0f, 1.0f, width);
+    }
+
+    /// The most the phase modulation depth goes to, either way. It keeps the modulated phases in the range they wrap from
+    static constexpr float maxPMDepth = 16.0f;
+
+    //==========================================================================
+    // Per voice settings. They stay with the voice from one note to the next.
+
+    /// Level of a voice, as a linear gain. 1 by default.
+    void setGain(int voice, float newGain)
+    {
+        voiceGain[(size_t) voice] = newGain;
+        updatePan(voice);
+    }
+
+    /// How much a note's velocity sets its level: 0, the default, plays every note at full level, 1 follows the velocity
+    void setVelocitySensitivity(float sensitivity)
+    {
+        velocitySensitivity = juce::jlimit(0.0f, 1.0f, sensitivity);
+    }
+
+    /// The gain for a note played at a velocity, from 0 to 1
+    float getVelocityGain(float velocity) const
+    {
+        return 1.0f - velocitySensitivity * (1.0f - velocity);
+    }
+
+    bool isPlaying(int voice) const                 { return copiesOfVoice[(size_t) voice] > 0; }
+
+    /**
+     The voice to give up for a new note, -1 if none is sounding. The quietest released one goes first, as it is on its way
+     out anyway, then the quietest one past its attack. A voice still in its attack goes last, however quiet it is so far:
+     it is the newest note. Of those, the one furthest into its attack, which is the oldest.
+     */
+    int findVoiceToSteal() const
+    {
+        int best = -1, bestRank = 0;
+        float bestLevel = 0.0f;
+
+        for (int s = 0; s < numActive; s++)
+        {
+            const int stage = envStage[(size_t) s];
+            const int rank = (stage == BlockEnvelope::release || stage == BlockEnvelope::idle) ? 0
+                                 : (stage == BlockEnvelope::attack ? 2 : 1);
+
+            //Lowest first, but in the attack highest first
+            const float level = rank == 2 ? -envLevel[(size_t) s] : envLevel[(size_t) s];
+
+            if (best < 0 || rank < bestRank || (rank == bestRank && level < bestLevel))
+            {
+                best = s;
+                bestRank = rank;
+                bestLevel = level;
+            }
+        }
+
+        return best < 0 ? -1 : voiceOfSlot[(size_t) best];
+    }
+
+    /// Bytes allocated by prepare() for the voice and slot state. The scratch space for rendering is in the DspArena
+    size_t getMemoryUsage() const
+    {
+        size_t bytes = 0;
+        auto add = [&bytes] (const auto& array) { bytes += array.capacity() * sizeof(array[0]); };
+
+        forEachSlotArray(*this, add);
+
+        add(slotsOfVoice);
+        add(copiesOfVoice);
+        add(voiceGain);
+        add(voiceOscPhase);
+        add(voiceDetunePhase);
+        add(voiceLfoPhase);
+        add(finishedVoices);
+
+        return bytes;
+    }
+
+    /**
+     Share the rendering with the threads of a pool. The pool must outlive the bank, or be set back to nullptr first.
+
+     @param pool the pool, or nullptr to render on the calling thread only
+     @param maxHelpers how many of the pool's workers to wake at most. Can change every block.
+     */
+    void setWorkerPool(RealtimeWorkerPool* pool, int maxHelpers)
+    {
+        workerPool = pool;
+        maxWorkerHelpers = maxHelpers;
+    }
+
+    /// The voices whose note died away during the last render(). Each of them then clears its note.
+    const std::vector<int>& getFinishedVoices() const
+    {
+        return finishedVoices;
+    }
+
+    //==========================================================================
+    /**
+     Render every playing slot and add the mix to every channel of the buffer.
+
+     The voices are summed into a mono span, which is then added to each channel with one vector add. Only when a playing
+     slot is panned is there a second span: then the even channels get the left mix and the odd ones the right.
+     */
+    void render(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
+    {
+        finishedVoices.clear();
+
+        //The sounding voices are slots 0 to numActive - 1, so only those groups
+        const int numGroups = (numActive + lanes - 1) / lanes;
+
+        if (numGroups == 0)
+        {
+            controlClock = (controlClock + numSamples) % controlInterval;
+            return;
+        }
+
+        bool stereo = false;
+
+        if (outputBuffer.getNumChannels() > 1)
+            for (int s = 0; s < numActive; s++)
+                stereo = stereo || pan[(size_t) s] != 0.0f;
+
+        const int numSides = stereo ? 2 : 1;
+        const int numTasks = (numGroups + groupsPerTask - 1) / groupsPerTask;
+
+        for (int chunkStart = startSample; chunkStart < startSample + numSamples; chunkStart += blockSize)
+        {
+            const int chunkLength = juce::jmin(blockSize, startSample + numSamples - chunkStart);
+
+            jobGroups = numGroups;
+            jobLength = chunkLength;
+            jobStereo = stereo;
+            jobToControl = controlInterval - controlClock;
+
+            //The per sample values of the chunk. A steady value is read with a stride of 0
+            jobMix = detuneMix.isRamping() ? detuneMix.ramp + chunkStart : &detuneMix.value;
+            jobMixStride = detuneMix.isRamping() ? 1 : 0;
+            jobLfoRamp = lfoRamp != nullptr ? lfoRamp + chunkStart : nullptr;
+            jobLfoDeltas = &lfoDelta;
+            jobLfoStride = 0;
+
+            if (lfoRamp != nullptr && lfoAudioRate)
+            {
+                for (int i = 0; i < chunkLength; i++)
+                    lfoDeltaRamp[(size_t) i] = toPhaseDelta(jobLfoRamp[i]);
+
+                jobLfoDeltas = lfoDeltaRamp;
+                jobLfoStride = 1;
+            }
+
+            if (workerPool != nullptr)
+                workerPool->run(*this, numTasks, maxWorkerHelpers);
+            else
+                for (int task = 0; task < numTasks; task++)
+                    runTask(task);
+
+            //Only now are the lanes added together, a fixed cost whatever the number of groups. The tasks always in the
+            //same order, so the threads can't change the rounding
+            for (int side = 0; side < numSides; side++)
+            {
+                for (int i = 0; i < chunkLength; i++)
+                {
+                    float sum = 0.0f;
+
+                    for (int task = 0; task < numTasks; task++)
+                    {
+                        const float* m = laneMix[side] + (task * blockSize + i) * lanes;
+
+                        for (int k = 0; k < lanes; k++)
+                            sum += m[k];
+                    }
+
+                    sideMix[side][(size_t) i] = sum;
+                }
+            }
+
+            for (int chan = 0; chan < outputBuffer.getNumChannels(); chan++)
+                outputBuffer.addFrom(chan, chunkStart, sideMix[chan % numSides], chunkLength);
+
+            controlClock = (controlClock + chunkLength) % controlInterval;
+        }
+
+        //Free the slots whose release ran out during the block. A voice is finished with its last copy
+        bool anyFreed = false;
+
+        for (int s = 0; s < numActive; s++)
+        {
+            if (envStage[(size_t) s] == BlockEnvelope::idle)
+            {
+                const int voice = voiceOfSlot[(size_t) s];
+                freeSlot(s);
+                anyFreed = true;
+
+                if (--copiesOfVoice[(size_t) voice] == 0)
+                {
+                    numPlaying--;
+                    finishedVoices.push_back(voice);
+                }
+            }
+        }
+
+        if (anyFreed)
+            removeFreeSlots();
+    }
+
+private:
+   #if ALPACON_PHASE_BITS
+    using Phase = FixedPointPhase::Phase;
+   #else
+    using Phase = float;
+   #endif
+
+    //==========================================================================
+    // The phase accumulators of "Oscillators.h", with the same float or fixed-point arithmetic
+
+    /// frequency / sampleRate, worked out the same way as PhasorBase::setFrequency()
+    Phase toPhaseDelta(float freq) const
+    {
+       #if ALPACON_PHASE_BITS
+        return FixedPointPhase::fromCycles((double) freq / (double) sampleRate);
+       #else
+        return freq / sampleRate;
+       #endif
+    }
+
+    static inline Phase step(Phase p, Phase delta)
+    {
+       #if ALPACON_PHASE_BITS
+        return p + delta;
+       #else
+        //The same as "if (phase > 1) phase -= 1" (the phase never goes past 2), written so that it vectorizes
+        p += delta;
+        return p - (float) (int) p;
+       #endif
+    }
+
+    /// A phase moved by a phase modulation in cycles (less than 64 either way), wrapped back round
+    static inline Phase modulate(Phase p, float cycles)
+    {
+       #if ALPACON_PHASE_BITS
+        return p + FixedPointPhase::fromOffset(cycles);
+       #else
+        //Through int rather than floor(), so it vectorizes
+        const float x = p + cycles;
+        return x - (float) ((int) (x + 64.0f) - 64);
+       #endif
+    }
+
+    static inline float toCycles(Phase p)
+    {
+       #if ALPACON_PHASE_BITS
+        return FixedPointPhase::toCycles(p);
+       #else
+        return p;
+       #endif
+    }
+
+    /**
+     The detune osc's increment for an LFO phase. The LFO is scaled with +1 and then scaled with detuneAmount multiplied,
+     to have a good but not wierd range of osciallation that is still a detuned sounds rather than another sound entirely
+     different. It takes the frequency down from the note by that much.
+     */
+    inline Phase detuneFromLFO(Phase centre, Phase lfo) const
+    {
+        const float offset = (SineKernels::polynomial(toCycles(lfo)) + 1.0f) * detuneScale;
+
+       #if ALPACON_PHASE_BITS
+        return centre - (Phase) (FixedPointPhase::Clock) offset;
+       #else
+        return centre - offset;
+       #endif
+    }
+
+    /// A 1 / controlInterval share of the way from one increment to another
+    static inline Phase controlStep(Phase from, Phase to)
+    {
+       #if ALPACON_PHASE_BITS
+        return (Phase) ((FixedPointPhase::Clock) (to - from) / controlInterval);
+       #else
+        return (to - from) * (1.0f / (float) controlInterval);
+       #endif
+    }
+
+    //==========================================================================
+    /// Every array with one entry per slot. A slot's state is everything at its index in these. (Static, so it works on a
+    /// const bank too.)
+    template <typename Bank, typename Function>
+    static void forEachSlotArray(Bank& bank, Function&& function)
+    {
+        for (auto* array : { &bank.envLevel, &bank.envMultiply, &bank.envAdd, &bank.envTarget, &bank.unisonPan, &bank.gain,
+                             &bank.pan, &bank.gainLeft, &bank.gainRight })
+            function(*array);
+
+        for (auto* array : { &bank.oscPhase, &bank.oscDelta, &bank.detunePhase, &bank.detuneCentre, &bank.detuneDelta,
+                             &bank.detuneStep, &bank.detuneTarget, &bank.lfoPhase })
+            function(*array);
+
+        for (auto* array : { &bank.oscLevel, &bank.envLength, &bank.envStage, &bank.voiceOfSlot, &bank.copyOfSlot })
+            function(*array);
+    }
+
+    /// Give a copy of a voice the next free slot, carrying on its oscillators from where the voice's last note left them
+    void takeSlot(int voice, int copy)
+    {
+        jassert(numActive < numVoices);
+
+        const int slot = numActive++;
+        const size_t s = (size_t) slot, v = (size_t) voice;
+
+        slotsOfVoice[v * maxUnison + (size_t) copy] = slot;
+        voiceOfSlot[s] = voice;
+        copyOfSlot[s] = copy;
+
+        oscPhase[s] = voiceOscPhase[v];
+        detunePhase[s] = voiceDetunePhase[v];
+        lfoPhase[s] = voiceLfoPhase[v];
+    }
+
+    /// A slot is done with: the voice keeps its first copy's phases. The slot stays where it is until removeFreeSlots()
+    void freeSlot(int slot)
+    {
+        const size_t s = (size_t) slot;
+        const int voice = voiceOfSlot[s];
+        const size_t v = (size_t) voice;
+
+        if (copyOfSlot[s] == 0)
+        {
+            voiceOscPhase[v] = oscPhase[s];
+            voiceDetunePhase[v] = detunePhase[s];
+            voiceLfoPhase[v] = lfoPhase[s];
+        }
+
+        slotsOfVoice[v * maxUnison + (size_t) copyOfSlot[s]] = -1;
+        voiceOfSlot[s] = -1;
+    }
+
+    /**
+     Close up the gaps freeSlot() left, keeping the other slots in their order. The voices are added up in slot order, so
+     moving the last slot into a gap would change the rounding of the mix, by how many blocks the host happened to free
+     the slots in.
+     */
+    void removeFreeSlots()
+    {
+        int kept = 0;
+
+        for (int s = 0; s < numActive; s++)
+        {
+            if (voiceOfSlot[(size_t) s] < 0)
+                continue;
+
+            if (s != kept)
+            {
+                const size_t from = (size_t) s, to = (size_t) kept;
+
+                forEachSlotArray(*this, [from, to] (auto& array) { array[to] = array[from]; });
+                voiceOfSlot[from] = -1;
+                slotsOfVoice[(size_t) voiceOfSlot[to] * maxUnison + (size_t) copyOfSlot[to]] = kept;
+            }
+
+            kept++;
+        }
+
+        numActive = kept;
+    }
+
+    /// Take a voice's note off the bank straight away, without finishing it (for a retrigger with another unison)
+    void dropSlots(int voice)
+    {
+        const size_t v = (size_t) voice;
+
+        if (copiesOfVoice[v] == 0)
+            return;
+
+        for (int copy = copiesOfVoice[v] - 1; copy >= 0; copy--)
+            freeSlot(slotsOfVoice[v * maxUnison + (size_t) copy]);
+
+        removeFreeSlots();
+        copiesOfVoice[v] = 0;
+        numPlaying--;
+    }
+
+    /// Somewhere in the first phaseRandomness of a cycle, as a phase
+    Phase randomPhase()
+    {
+        const float cycles = random.nextFloat() * unisonPhase;
+
+       #if ALPACON_PHASE_BITS
+        return FixedPointPhase::fromCycles(cycles);
+       #else
+        return cycles;
+       #endif
+    }
+
+    void setSegment(int slot, const BlockEnvelope::Segment& seg)
+    {
+        const size_t s = (size_t) slot;
+
+        envStage[s] = seg.stage;
+        envMultiply[s] = seg.multiply;
+        envAdd[s] = seg.add;
+        envTarget[s] = seg.target;
+        envLength[s] = seg.length;
+    }
+
+    /**
+     Unpanned, the gain of a voice on both sides. Otherwise the side it moves away from is turned down. Copies in unison
+     are panned around the middle, and share the voice's gain so that they add up to about the level of one.
+     */
+    void updatePan(int voice)
+    {
+        const size_t v = (size_t) voice;
+        const int numCopies = copiesOfVoice[v];
+
+        if (numCopies == 0)
+            return;
+
+        const float copyGain = voiceGain[v] / std::sqrt((float) numCopies);
+
+        for (int copy = 0; copy < numCopies; copy++)
+        {
+            const size_t s = (size_t) slotsOfVoice[v * maxUnison + (size_t) copy];
+            gain[s] = copyGain;
+            pan[s] = juce::jlimit(-1.0f, 1.0f, unisonPan[s]);
+            gainLeft[s] = gain[s] * juce::jmin(1.0f, 1.0f - pan[s]);
+            gainRight[s] = gain[s] * juce::jmin(1.0f, 1.0f + pan[s]);
+        }
+    }
+
+    /// One task of the current chunk: clear its lane mix and render its groups into it. Runs on any thread.
+    void runTask(int task) override
+    {
+        const size_t offset = (size_t) (task * blockSize * lanes);
+        const size_t length = (size_t) (jobLength * lanes);
+        float* outLeft = laneMix[0] + offset;
+        float* outRight = laneMix[1] + offset;
+
+        std::fill(outLeft, outLeft + length, 0.0f);
+
+        if (jobStereo)
+            std::fill(outRight, outRight + length, 0.0f);
+
+        const int endGroup = juce::jmin(jobGroups, (task + 1) * groupsPerTask);
+        const auto render = getGroupRenderer();
+
+        for (int group = task * groupsPerTask; group < endGroup; group++)
+            (this->*render)(group * lanes, jobLength, outLeft, outRight);
+    }
+
+    using GroupRenderer = void (VoiceBank::*) (int, int, float*, float*);
+
+    /// The renderGroup() for the current settings, picked once per task
+    GroupRenderer getGroupRenderer() const
+    {
+        switch (routing)
+        {
+            case sineModulatesTriangle:     return getGroupRenderer<sineModulatesTriangle>();
+            case triangleModulatesSine:     return getGroupRenderer<triangleModulatesSine>();
+            case mix:
+            default:                        return getGroupRenderer<mix>();
+        }
+    }
+
+    template <Routing routingToUse>
+    GroupRenderer getGroupRenderer() const
+    {
+        return pulse ? getGroupRenderer<routingToUse, true>() : getGroupRenderer<routingToUse, false>();
+    }
+
+    template <Routing routingToUse, bool pulseWave>
+    GroupRenderer getGroupRenderer() const
+    {
+        if (lfoAudioRate)
+            return jobStereo ? &VoiceBank::renderGroup<true, true, routingToUse, pulseWave>
+                             : &VoiceBank::renderGroup<false, true, routingToUse, pulseWave>;
+
+        return jobStereo ? &VoiceBank::renderGroup<true, false, routingToUse, pulseWave>
+                         : &VoiceBank::renderGroup<false, false, routingToUse, pulseWave>;
+    }
+
+    /**
+     Render one group of slots into a lane mix. The lane state lives in locals for the whole chunk.
+
+     The chunk goes in spans that end where one of the slots' envelope stages does, or at a control point, so inside a
+     span every envelope and every detune increment is one ramp. Slots past the sounding ones are rendered idle, at 0.
+
+     Each sample the triangle (or the pulse) goes first, then the detune sine, unless the sine modulates the triangle: then
+     the sine's phase moves on first.
+     */
+    template <bool stereo, bool audioRateLfo, Routing routingToUse, bool pulseWave>
+    void renderGroup(int first, int numSamples, float* mixLeft, float* mixRight)
+    {
+        Phase osc[lanes], oscInc[lanes], lfo[lanes];
+        Phase det[lanes], detCentre[lanes], detInc[lanes], detStep[lanes], detNext[lanes];
+        int level[lanes], stage[lanes], length[lanes];
+        float env[lanes], multiply[lanes], add[lanes], target[lanes], left[lanes], right[lanes];
+
+        //The phases of the sample a note ended on. The slot runs on silently until the end of render(), wherever the host
+        //ends the block, so the voice's next note carries on from these instead
+        Phase endOsc[lanes], endDet[lanes], endLfo[lanes];
+        bool ended[lanes];
+
+        for (int k = 0; k < lanes; k++)
+        {
+            const size_t s = (size_t) (first + k);
+
+            osc[k] = oscPhase[s];
+            oscInc[k] = oscDelta[s];
+            det[k] = detunePhase[s];
+            detCentre[k] = detuneCentre[s];
+            detInc[k] = detuneDelta[s];
+            detStep[k] = detuneStep[s];
+            detNext[k] = detuneTarget[s];
+            lfo[k] = lfoPhase[s];
+            level[k] = oscLevel[s];
+            left[k] = stereo ? gainLeft[s] : gain[s];
+            right[k] = gainRight[s];
+
+            const BlockEnvelope::Segment silent;
+            const bool sounding = first + k < numActive;
+
+            stage[k] = sounding ? envStage[s] : silent.stage;
+            env[k] = sounding ? envLevel[s] : 0.0f;
+            multiply[k] = sounding ? envMultiply[s] : silent.multiply;
+            add[k] = sounding ? envAdd[s] : silent.add;
+            target[k] = sounding ? envTarget[s] : silent.target;
+            length[k] = sounding ? envLength[s] : silent.length;
+
+            ended[k] = stage[k] == BlockEnvelope::idle;
+            endOsc[k] = osc[k];
+            endDet[k] = det[k];
+            endLfo[k] = lfo[k];
+        }
+
+        const float* table = pulseWave ? saw : triangle;
+
+        //Where the pulse's second saw reads, a width behind the first
+       #if ALPACON_PHASE_BITS
+        const uint32_t widthBehind = FixedPointPhase::top32(FixedPointPhase::fromCycles(pulseWidth));
+       #else
+        const float widthBehind = pulseWidth * (float) Wavetable::tableSize;
+       #endif
+        const float pulseOffset = pulseWidth - 0.5f;
+
+        const float depth = pmDepth;
+        int toControl = audioRateLfo ? BlockEnvelope::forever : jobToControl;
+        Phase lfoInc = lfoDelta;
+
+        //In locals, or the compiler would load them again after every store to the mix
+        const float* const mixValues = jobMix;
+        const Phase* const lfoDeltas = jobLfoDeltas;
+        const int mixStride = jobMixStride, lfoStride = jobLfoStride;
+        const float on = detuneOn;
+
+        for (int spanStart = 0; spanStart < numSamples;)
+        {
+            //Up to where the first stage ends, or the next control point
+            int spanLength = juce::jmin(numSamples - spanStart, toControl);
+
+            for (int k = 0; k < lanes; k++)
+                spanLength = juce::jmin(spanLength, length[k]);
+
+            const int spanEnd = spanStart + spanLength;
+
+            //The detune osc's next phase. Its frequency follows the LFO: worked out now, or on its way to the next control
+            //point. Inlined into the lane loops, so the lane arrays stay in registers
+            auto stepDetune = [&] (int k)
+            {
+                if (audioRateLfo)
+                {
+                    lfo[k] = step(lfo[k], lfoInc);
+                    detInc[k] = detuneFromLFO(detCentre[k], lfo[k]);
+                }
+                else
+                {
+                    detInc[k] += detStep[k];
+                }
+
+                det[k] = step(det[k], detInc[k]);
+                return toCycles(det[k]);
+            };
+
+            for (int i = spanStart; i < spanEnd; i++)
+            {
+                int index[lanes], behindIndex[lanes];
+                float frac[lanes], behindFrac[lanes], wave[lanes], detuned[lanes];
+
+                //If the user selects "detune" option as 1 through UI, mix in the "detuned" sound. With it off the mix is 0
+                const float m = mixValues[i * mixStride] * on;
+
+                if (audioRateLfo)
+                    lfoInc = lfoDeltas[i * lfoStride];
+
+                //The modulating sine, ahead of the triangle it modulates
+                if (routingToUse == sineModulatesTriangle)
+                {
+                   #pragma GCC unroll 1
+                    for (int k = 0; k < lanes; k++)
+                        detuned[k] = SineKernels::polynomial(stepDetune(k));
+                }
+
+                //The triangle's phase and where it falls in the table
+                for (int k = 0; k < lanes; k++)
+                {
+                    osc[k] = step(osc[k], oscInc[k]);
+
+                    Phase p = osc[k];
+
+                    if (routingToUse == sineModulatesTriangle)
+                        p = modulate(p, depth * detuned[k]);
+
+                   #if ALPACON_PHASE_BITS
+                    const uint32_t top = FixedPointPhase::top32(p);
+                    index[k] = (int) (top >> (32 - Wavetable::tableBits)) + level[k];
+                    frac[k] = (float) (top & ((1u << (32 - Wavetable::tableBits)) - 1))
+                                * (1.0f / (float) (1u << (32 - Wavetable::tableBits)));
+
+                    if (pulseWave)
+                    {
+                        //Wraps by overflowing
+                        const uint32_t behind = top - widthBehind;
+                        behindIndex[k] = (int) (behind >> (32 - Wavetable::tableBits)) + level[k];
+                        behindFrac[k] = (float) (behind & ((1u << (32 - Wavetable::tableBits)) - 1))
+                                          * (1.0f / (float) (1u << (32 - Wavetable::tableBits)));
+                    }
+                   #else
+                    //The phase is in 0-1 here, so no floor() is needed
+                    const float x = p * (float) Wavetable::tableSize;
+                    const int whole = (int) x;
+                    frac[k] = x - (float) whole;
+                    index[k] = (whole & (Wavetable::tableSize - 1)) + level[k];
+
+                    if (pulseWave)
+                    {
+                        //A whole cycle on, so it is never negative
+                        const float behind = x - widthBehind + (float) Wavetable::tableSize;
+                        const int behindWhole = (int) behind;
+                        behindFrac[k] = behind - (float) behindWhole;
+                        behindIndex[k] = (behindWhole & (Wavetable::tableSize - 1)) + level[k];
+                    }
+                   #endif
+                }
+
+                //The table reads are a gather, kept in their own loop so the others stay vectorizable
+                for (int k = 0; k < lanes; k++)
+                    wave[k] = table[index[k]] + frac[k] * (table[index[k] + 1] - table[index[k]]);
+
+                //The saw a width behind less the saw now is 1 - width up to the width and -width after it. The offset
+                //moves that onto +-0.5, and the half brings it down to the triangle's level
+                if (pulseWave)
+                {
+                    for (int k = 0; k < lanes; k++)
+                    {
+                        const int i0 = behindIndex[k];
+                        const float behindSaw = table[i0] + behindFrac[k] * (table[i0 + 1] - table[i0]);
+                        wave[k] = 0.5f * (behindSaw - wave[k] + pulseOffset);
+                    }
+                }
+
+                float* outLeft = mixLeft + i * lanes;
+                float* outRight = mixRight + i * lanes;
+
+                //Small enough now that GCC would unroll it into four lots of scalar code, which it then fails to put back
+                //together into vectors. As a loop it vectorizes (clang reads this pragma too)
+               #pragma GCC unroll 1
+                for (int k = 0; k < lanes; k++)
+                {
+                    //The sine, unless it went first. The polynomial takes any phase that fits an int, so a modulated one needs no wrap
+                    if (routingToUse == triangleModulatesSine)
+                        detuned[k] = SineKernels::polynomial(stepDetune(k) + depth * wave[k]);
+                    else if (routingToUse == mix)
+                        detuned[k] = SineKernels::polynomial(stepDetune(k));
+
+                    const float voice = (wave[k] * (1.0f - m)) + (detuned[k] * m);
+
+                    //The ADSR, one ramp for the whole span. Idle slots multiply by 0 and add 0, so they are silent
+                    env[k] = env[k] * multiply[k] + add[k];
+
+                    const float sound = voice * env[k];
+                    outLeft[k] += sound * left[k];
+
+                    if (stereo)
+                        outRight[k] += sound * right[k];
+                }
+            }
+
+            //The stages that ended here land exactly on their target, and the next ones start
+            for (int k = 0; k < lanes; k++)
+            {
+                length[k] -= spanLength;
+
+                if (length[k] == 0)
+                {
+                    //Through a copy: an array whose address is taken can't stay in registers
+                    float newLevel = 0.0f;
+                    const auto seg = envelope.next(stage[k], target[k], newLevel);
+
+                    env[k] = newLevel;
+                    stage[k] = seg.stage;
+                    multiply[k] = seg.multiply;
+                    add[k] = seg.add;
+                    target[k] = seg.target;
+                    length[k] = seg.length;
+
+                    if (seg.stage == BlockEnvelope::idle)
+                    {
+                        ended[k] = true;
+                        endOsc[k] = osc[k];
+                        endDet[k] = det[k];
+                        endLfo[k] = lfo[k];
+                    }
+                }
+            }
+
+            //A control point: every increment lands on the one it was heading for, then the LFO gives the next
+            if (! audioRateLfo)
+            {
+                toControl -= spanLength;
+
+                if (toControl == 0)
+                {
+                    //The LFO rate of this sample carries it to the next control point
+                    const Phase controlDelta = jobLfoRamp != nullptr
+                                                 ? toPhaseDelta(jobLfoRamp[spanEnd - 1] * (float) controlInterval)
+                                                 : lfoControlDelta;
+
+                    for (int k = 0; k < lanes; k++)
+                    {
+                        lfo[k] = step(lfo[k], controlDelta);
+                        detInc[k] = detNext[k];
+                        detNext[k] = detuneFromLFO(detCentre[k], lfo[k]);
+                        detStep[k] = controlStep(detInc[k], detNext[k]);
+                    }
+
+                    toControl = controlInterval;
+                }
+            }
+
+            spanStart = spanEnd;
+        }
+
+        for (int k = 0; k < lanes; k++)
+        {
+            const size_t s = (size_t) (first + k);
+
+            oscPhase[s] = ended[k] ? endOsc[k] : osc[k];
+            detunePhase[s] = ended[k] ? endDet[k] : det[k];
+            lfoPhase[s] = ended[k] ? endLfo[k] : lfo[k];
+            detuneDelta[s] = detInc[k];
+            detuneStep[s] = audioRateLfo ? Phase() : detStep[k];
+            detuneTarget[s] = audioRateLfo ? detInc[k] : detNext[k];
+            envLevel[s] = env[k];
+            setSegment((int) s, { stage[k], multiply[k], add[k], target[k], length[k] });
+        }
+    }
+
+    juce::SharedResourcePointer<WavetableBank> wavetables;
+    const float* triangle = nullptr;
+    const float* saw = nullptr;
+
+    int numVoices = 0;
+    int numActive = 0;
+    int blockSize = 0;
+    float sampleRate = 44100.0f;
+
+    BlockEnvelope envelope;
+
+    //Shared by every voice. The detune amount starts where the voice's did. The detune scale is the detune amount as a
+    //phase increment, in the units of Phase
+    float detuneAmount = 2.0f, detuneOn = 0.0f, detuneScale = 0.0f;
+    float lfoFrequency = 0.0f;
+
+    //Steady, or ramps from the start of the block (see setDetuneMix())
+    SmoothedSpan detuneMix;
+    const float* lfoRamp = nullptr;
+
+    //Unison, for the next notes, and where the copies' phases come from
+    int unisonCount = 1;
+    float unisonSpread = 0.0f, unisonWidth = 0.0f, unisonPhase = 0.0f;
+    float velocitySensitivity = 0.0f;
+    juce::Random random { 1 };
+    int numPlaying = 0;
+    Phase lfoDelta = Phase(), lfoControlDelta = Phase();
+    bool lfoAudioRate = false;
+
+    Routing routing = mix;
+    float pmDepth = 0.0f;
+    bool pulse = false;
+    float pulseWidth = 0.5f;
+
+    //Samples since the last control point. It runs on whether or not anything is sounding
+    int controlClock = 0;
+
+    //One entry per slot (see forEachSlotArray())
+    std::vector<Phase> oscPhase, oscDelta, detunePhase, detuneCentre, detuneDelta, detuneStep, detuneTarget, lfoPhase;
+    std::vector<int> oscLevel;
+    std::vector<float> envLevel, envMultiply, envAdd, envTarget;
+    std::vector<int> envLength, envStage;
+    std::vector<float> unisonPan, gain, pan, gainLeft, gainRight;
+    std::vector<int> voiceOfSlot, copyOfSlot;
+
+    //One entry per voice
+    std::vector<int> slotsOfVoice, copiesOfVoice;
+    std::vector<float> voiceGain;
+    std::vector<Phase> voiceOscPhase, voiceDetunePhase, voiceLfoPhase;
+    std::vector<int> finishedVoices;
+
+    //Scratch, in the arena: every lane's output for every sample of a chunk, one span per task, and their sum. Left (or mono)
+    //then right.
+    float* laneMix[2] = {};
+    float* sideMix[2] = {};
+
+    //The LFO increment of every sample of a chunk, while the LFO rate ramps at audio rate
+    Phase* lfoDeltaRamp = nullptr;
+    int maxTasks = 1;
+
+    //The chunk being rendered, for the tasks
+    int jobGroups = 0, jobLength = 0, jobToControl = controlInterval;
+    bool jobStereo = false;
+    const float* jobMix = nullptr;
+    const float* jobLfoRamp = nullptr;
+    const Phase* jobLfoDeltas = nullptr;
+    int jobMixStride = 0, jobLfoStride = 0;
+
+    RealtimeWorkerPool* workerPool = nullptr;
+    int maxWorkerHelpers = 0;
+};
@@ -0,0 +1,208 @@
+/*
+  ==============================================================================
+
+    Wavetable.h
+    Created: 17 Oct 2026 3:26:52pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+#include "Oscillators.h"
+
+/**
+ A band-limited, mip-mapped wavetable for one single-cycle waveform.
+
+ "TriOsc" and "SquareOsc" work out the ideal waveform at every sample. Every harmonic above Nyquist folds back as aliasing,
+ and the crusher then brings it up further. A Wavetable holds one copy of the cycle per octave. Each copy only has the
+ harmonics that stay below Nyquist for the notes it plays, so an oscillator reading from the right one never aliases.
+
+ The copies come from a DFT of any single cycle, so a user waveform (or a cycle rendered from one of the oscillators in
+ "Oscillators.h") loads the same way as the built in shapes. The DC of the source is kept. Building is far too slow for the
+ audio thread. Once built, the tables are only ever read, so any number of voices can share them.
+ */
+class Wavetable
+{
+public:
+    /// Points in one cycle. A power of two, so the index wraps with a mask.
+    static constexpr int tableBits = 11;
+    static constexpr int tableSize = 1 << tableBits;
+
+    /// One level per octave. Level 0 has every harmonic the table can hold, the one before the last only the fundamental.
+    /// The last has nothing but the DC, for notes whose fundamental is itself above Nyquist.
+    static constexpr int numLevels = 12;
+
+    /// Starts out silent
+    Wavetable()
+        : data((size_t) (numLevels * (tableSize + 1)), 0.0f)
+    {
+    }
+
+    /**
+     Build every level from one cycle of a waveform. Allocates and runs a DFT: call from the message thread or
+     prepareToPlay, while no oscillator reads this table.
+
+     @param cycle one cycle of the waveform, sample 0 at phase 0. Any length.
+     @param length how many samples are in the cycle
+     */
+    void loadWaveform(const float* cycle, int length)
+    {
+        jassert(cycle != nullptr && length > 0);
+
+        const int maxHarmonic = juce::jmin(tableSize / 2, length / 2);
+        std::vector<double> cosAmps((size_t) maxHarmonic + 1), sinAmps((size_t) maxHarmonic + 1);
+
+        //Analysis. The twiddle factors come from a rotation in double rather than a sin/cos call per point
+        for (int h = 0; h <= maxHarmonic; h++)
+        {
+            const double w = 2.0 * juce::MathConstants<double>::pi * h / length;
+            const double cosStep = std::cos(w), sinStep = std::sin(w);
+            double c = 1.0, s = 0.0, sumCos = 0.0, sumSin = 0.0;
+
+            for (int n = 0; n < length; n++)
+            {
+                sumCos += cycle[n] * c;
+                sumSin += cycle[n] * s;
+
+                const double newS = s * cosStep + c * sinStep;
+                c = c * cosStep - s * sinStep;
+                s = newS;
+            }
+
+            //DC, and the Nyquist bin of an even length, only count once
+            const bool single = (h == 0) || (2 * h == length);
+            cosAmps[(size_t) h] = sumCos * (single ? 1.0 : 2.0) / length;
+            sinAmps[(size_t) h] = sumSin * (single ? 1.0 : 2.0) / length;
+        }
+
+        //Synthesis, one level at a time, with each harmonic read from a sine table by index
+        std::vector<double> sine((size_t) tableSize);
+
+        for (int i = 0; i < tableSize; i++)
+            sine[(size_t) i] = std::sin(2.0 * juce::MathConstants<double>::pi * i / tableSize);
+
+        for (int level = 0; level < numLevels; level++)
+        {
+            const int numHarmonics = juce::jmin(maxHarmonic, getNumHarmonics(level));
+            float* dest = getLevel(level);
+
+            for (int i = 0; i < tableSize; i++)
+            {
+                double val = cosAmps[0];
+
+                for (int h = 1; h <= numHarmonics; h++)
+                {
+                    const int index = (h * i) & (tableSize - 1);
+                    val += cosAmps[(size_t) h] * sine[(size_t) ((index + tableSize / 4) & (tableSize - 1))]
+                         + sinAmps[(size_t) h] * sine[(size_t) index];
+                }
+
+                dest[i] = (float) val;
+            }
+
+            //One extra point past the end, so the interpolation never has to wrap
+            dest[tableSize] = dest[0];
+        }
+    }
+
+    /// How many harmonics a level keeps: the most that stay below Nyquist at the fastest phase the level is used for
+    static int getNumHarmonics(int level)
+    {
+        return (tableSize / 2) >> level;
+    }
+
+    /// The level to read for a phase increment (frequency / sample rate). Work it out when the frequency changes.
+    static int getLevelFor(float phaseDelta)
+    {
+        //Level n is good up to 2^n / tableSize, so this is ceil (log2 (phaseDelta * tableSize)). Past 0.5 even the
+        //fundamental is above Nyquist, and that lands on the silent last level
+        int exponent = 0;
+        const float mantissa = std::frexp(std::abs(phaseDelta) * (float) tableSize, &exponent);
+
+        if (mantissa == 0.5f)
+            exponent--;
+
+        return juce::jlimit(0, numLevels - 1, exponent);
+    }
+
+    const float* getLevel(int level) const
+    {
+        return data.data() + (size_t) level * (tableSize + 1);
+    }
+
+    /// Linear interpolation in one level. Works for any phase. No branches, so a loop of these can use vector gathers.
+    static inline float lookup(const float* level, float p)
+    {
+        const float x = (p - std::floor(p)) * (float) tableSize;
+        const int i = (int) x;
+        const float frac = x - (float) i;
+        const int index = i & (tableSize - 1);
+
+        return level[index] + frac * (level[index + 1] - level[index]);
+    }
+
+    /// The same from a 32 bit fixed-point phase (see "FixedPointPhase.h"). The index is just the top bits.
+    static inline float lookup(const float* level, uint32_t phase)
+    {
+        const uint32_t index = phase >> (32 - tableBits);
+        const float frac = (float) (phase & ((1u << (32 - tableBits)) - 1)) * (1.0f / (float) (1u << (32 - tableBits)));
+
+        return level[index] + frac * (level[index + 1] - level[index]);
+    }
+
+private:
+    float* getLevel(int level)
+    {
+        return data.data() + (size_t) level * (tableSize + 1);
+    }
+
+    std::vector<float> data;
+};
+
+/**
+ The built in wavetables, made once and shared by every voice of every plugin instance. Hold one with a
+ juce::SharedResourcePointer<WavetableBank>: the first one builds the tables (some tens of milliseconds), so create it
+ on the message thread, not in the audio callback.
+ */
+class WavetableBank
+{
+public:
+    enum Shape
+    {
+        triangle = 0,
+        saw,
+        numShapes
+    };
+
+    WavetableBank()
+    {
+        std::vector<float> cycle((size_t) Wavetable::tableSize);
+        const float size = (float) Wavetable::tableSize;
+
+        //The triangle is rendered from TriOsc itself, so it keeps its shape and its DC and only loses the aliasing
+        TriOsc tri;
+        for (int i = 0; i < Wavetable::tableSize; i++)
+            cycle[(size_t) i] = tri.output((float) i / size);
+
+        tables[triangle].loadWaveform(cycle.data(), Wavetable::tableSize);
+
+        //A rising saw from -0.5 to 0.5. The point on the jump sits half way, so it is not lopsided
+        for (int i = 0; i < Wavetable::tableSize; i++)
+            cycle[(size_t) i] = (float) i / size - 0.5f;
+
+        cycle[0] = 0.0f;
+        tables[saw].loadWaveform(cycle.data(), Wavetable::tableSize);
+    }
+
+    const Wavetable& getTable(Shape shape) const
+    {
+        return tables[shape];
+    }
+
+private:
+    Wavetable tables[numShapes];
+};